@@ -25,12 +25,20 @@
 namespace android {
 namespace base {
 
+std::atomic<int> gGuestTracingState(-1);
+std::atomic<uint32_t> gGuestTracingRecheck(kGuestTracingRecheckInterval);
+
 bool isTracingEnabled() {
-    return atrace_is_tag_enabled(ATRACE_TAG_GRAPHICS);
+    bool enabled = atrace_is_tag_enabled(ATRACE_TAG_GRAPHICS);
+    gGuestTracingState.store(enabled ? 1 : 0, std::memory_order_relaxed);
+    gGuestTracingRecheck.store(kGuestTracingRecheckInterval, std::memory_order_relaxed);
+    return enabled;
 }
 
-void ScopedTraceGuest::beginTraceImpl(const char* name) {
+bool ScopedTraceGuest::beginTraceImpl(const char* name) {
+    if (!isTracingEnabled()) return false;
     atrace_begin(VK_TRACE_TAG, name);
+    return true;
 }
 
 void ScopedTraceGuest::endTraceImpl(const char*) {
@@ -51,15 +59,20 @@ void ScopedTraceGuest::endTraceImpl(const char*) {
 namespace android {
 namespace base {
 
+// The trace macros check their category themselves.
+std::atomic<int> gGuestTracingState(1);
+std::atomic<uint32_t> gGuestTracingRecheck(kGuestTracingRecheckInterval);
+
 bool isTracingEnabled() {
     // TODO: Fuchsia
     return false;
 }
 
-void ScopedTraceGuest::beginTraceImpl(const char* name) {
+bool ScopedTraceGuest::beginTraceImpl(const char* name) {
 #ifndef FUCHSIA_NO_TRACE
     TRACE_DURATION_BEGIN(VK_TRACE_TAG, name);
 #endif
+    return true;
 }
 
 void ScopedTraceGuest::endTraceImpl(const char* name) {
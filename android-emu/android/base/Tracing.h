@@ -14,6 +14,10 @@
 // limitations under the License.
 #pragma once
 
+#include <atomic>
+
+#include <stdint.h>
+
 // Library to perform tracing. Talks to platform-specific
 // tracing libraries.
 
@@ -44,20 +48,48 @@ public:
 
 bool isTracingEnabled();
 
+// Last result of isTracingEnabled(): 1 if enabled, 0 if not, -1 if not
+// queried yet. Every isTracingEnabled() call refreshes it. Scoped traces
+// test this flag inline, so a disabled trace point costs a few loads and
+// branches.
+//
+// While tracing is off, every kGuestTracingRecheckInterval-th trace point
+// queries atrace again, so that tracing turned on later is picked up by
+// processes that never present a frame. Once on, every trace point
+// queries it, so turning tracing off takes effect immediately.
+extern std::atomic<int> gGuestTracingState;
+static const uint32_t kGuestTracingRecheckInterval = 256;
+// Trace points left until the next recheck. Decremented without an atomic
+// read-modify-write; a lost decrement only delays the recheck.
+extern std::atomic<uint32_t> gGuestTracingRecheck;
+
 class ScopedTraceGuest {
 public:
-    ScopedTraceGuest(const char* name) : name_(name) {
-        beginTraceImpl(name_);
+    ScopedTraceGuest(const char* name) : name_(name), active_(false) {
+        if (__builtin_expect(
+                gGuestTracingState.load(std::memory_order_relaxed) != 0, 0)) {
+            active_ = beginTraceImpl(name_);
+            return;
+        }
+        uint32_t recheck = gGuestTracingRecheck.load(std::memory_order_relaxed);
+        if (__builtin_expect(recheck == 0, 0)) {
+            active_ = beginTraceImpl(name_);
+        } else {
+            gGuestTracingRecheck.store(recheck - 1, std::memory_order_relaxed);
+        }
     }
 
     ~ScopedTraceGuest() {
-        endTraceImpl(name_);
+        if (active_) endTraceImpl(name_);
     }
 private:
-    void beginTraceImpl(const char* name);
+    // Queries whether tracing is enabled, refreshing gGuestTracingState,
+    // and begins the trace if it is. Returns false if it is not.
+    bool beginTraceImpl(const char* name);
     void endTraceImpl(const char* name);
 
     const char* const name_;
+    bool active_;
 };
 
 } // namespace base
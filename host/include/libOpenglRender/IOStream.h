@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "ErrorLog.h"
 
@@ -31,6 +32,9 @@ public:
         m_bufsize = bufSize;
         m_free = 0;
         m_refcount = 1;
+        m_committedSize = 0;
+        m_markNextAlloc = false;
+        m_markedAllocTimeNs = 0;
     }
 
     void incRef() {
@@ -66,6 +70,11 @@ public:
 
     virtual unsigned char *alloc(size_t len) {
 
+        if (m_markNextAlloc) {
+            m_markNextAlloc = false;
+            m_markedAllocTimeNs = currentTimeNs();
+        }
+
         if (m_iostreamBuf && len > m_free) {
             if (flush() < 0) {
                 ERR("Failed to flush in alloc\n");
@@ -95,15 +104,37 @@ public:
 
         if (!m_iostreamBuf || m_free == m_bufsize) return 0;
 
+        m_committedSize += m_bufsize - m_free;
         int stat = commitBuffer(m_bufsize - m_free);
         m_iostreamBuf = NULL;
         m_free = 0;
         return stat;
     }
 
+    // Bytes allocated in the current buffer and not committed yet.
+    size_t pendingSize() const {
+        return m_iostreamBuf ? m_bufsize - m_free : 0;
+    }
+
+    // Bytes encoded through alloc() so far, committed or not. Data that
+    // encoders write directly with writeFully() is not included.
+    uint64_t encodedSize() const {
+        return m_committedSize + pendingSize();
+    }
+
+    // Makes the next alloc() record its time, for frame timelines.
+    void markNextAlloc() {
+        m_markNextAlloc = true;
+        m_markedAllocTimeNs = 0;
+    }
+
+    // CLOCK_BOOTTIME of the alloc() after markNextAlloc(); 0 if none yet.
+    uint64_t markedAllocTimeNs() const { return m_markedAllocTimeNs; }
+
     const unsigned char *readback(void *buf, size_t len) {
         if (m_iostreamBuf && m_free != m_bufsize) {
             size_t size = m_bufsize - m_free;
+            m_committedSize += size;
             m_iostreamBuf = NULL;
             m_free = 0;
             return commitBufferAndReadFully(size, buf, len);
@@ -126,11 +157,24 @@ protected:
     }
 
 private:
+    static uint64_t currentTimeNs() {
+        struct timespec ts;
+#ifdef __APPLE__
+        clock_gettime(CLOCK_REALTIME, &ts);
+#else
+        clock_gettime(CLOCK_BOOTTIME, &ts);
+#endif
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
     unsigned char *m_iostreamBuf;
     size_t m_bufsizeOrig;
     size_t m_bufsize;
     size_t m_free;
     uint32_t m_refcount;
+    uint64_t m_committedSize;
+    bool m_markNextAlloc;
+    uint64_t m_markedAllocTimeNs;
 };
 
 //
@@ -10,6 +10,7 @@ commonSources := \
         GLSharedGroup.cpp \
         glUtils.cpp \
         IndexRangeCache.cpp \
+        ProgramBinaryCache.cpp \
         SocketStream.cpp \
         TcpStream.cpp \
         auto_goldfish_dma_context.cpp \
@@ -0,0 +1,160 @@
+/*
+* Copyright (C) 2021 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <GLES/gl.h>
+
+#include <map>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Map from GL object name to T, for the per-context object tables that are
+// looked up on every bind and validation.
+//
+// GL names are small, mostly dense integers, so names below kMaxDenseName
+// live in lazily allocated pages of 256 slots and a lookup is two indexed
+// loads. Larger names fall back to a std::map. Values are heap allocated
+// individually, so references stay valid until the name is erased.
+template <class T>
+class DenseNameMap {
+public:
+    static const GLuint kMaxDenseName = 1 << 16;
+
+    DenseNameMap() : m_size(0) { }
+    ~DenseNameMap() { clear(); }
+
+    // NULL if |name| is not present.
+    T* find(GLuint name) const {
+        if (name < kMaxDenseName) {
+            size_t page = name >> kPageBits;
+            if (page >= m_pages.size() || !m_pages[page]) return NULL;
+            return m_pages[page]->slots[name & kPageMask];
+        }
+
+        typename std::map<GLuint, T*>::const_iterator it = m_sparse.find(name);
+        return it == m_sparse.end() ? NULL : it->second;
+    }
+
+    // Inserts |value| unless |name| is already present. Returns the stored
+    // value either way.
+    T& insert(GLuint name, const T& value) {
+        T** slot = slotFor(name);
+        if (!*slot) {
+            *slot = new T(value);
+            ++m_size;
+        }
+        return **slot;
+    }
+
+    // Like std::map::operator[].
+    T& operator[](GLuint name) {
+        T* value = find(name);
+        return value ? *value : insert(name, T());
+    }
+
+    void erase(GLuint name) {
+        if (name < kMaxDenseName) {
+            size_t page = name >> kPageBits;
+            if (page >= m_pages.size() || !m_pages[page]) return;
+            T*& slot = m_pages[page]->slots[name & kPageMask];
+            if (slot) {
+                delete slot;
+                slot = NULL;
+                --m_size;
+            }
+            return;
+        }
+
+        typename std::map<GLuint, T*>::iterator it = m_sparse.find(name);
+        if (it != m_sparse.end()) {
+            delete it->second;
+            m_sparse.erase(it);
+            --m_size;
+        }
+    }
+
+    void clear() {
+        for (size_t i = 0; i < m_pages.size(); ++i) {
+            if (!m_pages[i]) continue;
+            for (size_t j = 0; j < kPageSize; ++j) {
+                delete m_pages[i]->slots[j];
+            }
+            delete m_pages[i];
+        }
+        m_pages.clear();
+
+        for (typename std::map<GLuint, T*>::iterator it = m_sparse.begin();
+             it != m_sparse.end(); ++it) {
+            delete it->second;
+        }
+        m_sparse.clear();
+
+        m_size = 0;
+    }
+
+    size_t size() const { return m_size; }
+
+    // Calls f(name, value) for every entry in increasing name order, until f
+    // returns false.
+    template <class F>
+    void forEach(F f) {
+        for (size_t i = 0; i < m_pages.size(); ++i) {
+            if (!m_pages[i]) continue;
+            for (size_t j = 0; j < kPageSize; ++j) {
+                T* value = m_pages[i]->slots[j];
+                if (value && !f((GLuint)((i << kPageBits) | j), *value)) return;
+            }
+        }
+
+        for (typename std::map<GLuint, T*>::iterator it = m_sparse.begin();
+             it != m_sparse.end(); ++it) {
+            if (!f(it->first, *it->second)) return;
+        }
+    }
+
+private:
+    static const size_t kPageBits = 8;
+    static const size_t kPageSize = 1 << kPageBits;
+    static const size_t kPageMask = kPageSize - 1;
+
+    struct Page {
+        Page() {
+            for (size_t i = 0; i < kPageSize; ++i) slots[i] = NULL;
+        }
+        T* slots[kPageSize];
+    };
+
+    T** slotFor(GLuint name) {
+        if (name >= kMaxDenseName) {
+            return &m_sparse.insert(std::make_pair(name, (T*)NULL)).first->second;
+        }
+
+        size_t page = name >> kPageBits;
+        if (page >= m_pages.size()) m_pages.resize(page + 1, NULL);
+        if (!m_pages[page]) m_pages[page] = new Page();
+        return &m_pages[page]->slots[name & kPageMask];
+    }
+
+    // Not copyable; values are owned.
+    DenseNameMap(const DenseNameMap&);
+    DenseNameMap& operator=(const DenseNameMap&);
+
+    std::vector<Page*> m_pages;
+    std::map<GLuint, T*> m_sparse;
+    size_t m_size;
+};
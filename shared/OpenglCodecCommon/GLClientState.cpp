@@ -59,6 +59,8 @@ void GLClientState::init() {
 
     m_arrayBuffer = 0;
     m_arrayBuffer_lastEncode = 0;
+    m_clientActiveTexture_lastEncode = 0;
+    memset(m_promotedArrayBuffers, 0, sizeof(m_promotedArrayBuffers));
 
     m_attribEnableCache = 0;
     m_vaoAttribBindingCacheInvalid = 0xffff;
@@ -242,19 +244,16 @@ void GLClientState::removeVertexArrayObjects(GLsizei n, const GLuint* arrays) {
 }
 
 void GLClientState::addVertexArrayObject(GLuint name) {
-    if (m_vaoMap.find(name) !=
-        m_vaoMap.end()) {
+    if (m_vaoMap.find(name)) {
         ALOGE("%s: ERROR: %u already part of current VAO state!",
               __FUNCTION__, name);
         return;
     }
 
-    m_vaoMap.insert(
-            VAOStateMap::value_type(
-                name,
-                VAOState(0, CODEC_MAX_VERTEX_ATTRIBUTES, CODEC_MAX_VERTEX_ATTRIBUTES)));
-    VertexAttribStateVector& attribState =
-        m_vaoMap.find(name)->second.attribState;
+    VAOState& vaoState = m_vaoMap.insert(
+            name,
+            VAOState(0, CODEC_MAX_VERTEX_ATTRIBUTES, CODEC_MAX_VERTEX_ATTRIBUTES));
+    VertexAttribStateVector& attribState = vaoState.attribState;
     for (int i = 0; i < CODEC_MAX_VERTEX_ATTRIBUTES; i++) {
         attribState[i].enabled = 0;
         attribState[i].enableDirty = false;
@@ -266,8 +265,7 @@ void GLClientState::addVertexArrayObject(GLuint name) {
         attribState[i].type = GL_FLOAT; // GL_FLOAT is the default type
     }
 
-    VertexAttribBindingVector& bindingState =
-        m_vaoMap.find(name)->second.bindingState;
+    VertexAttribBindingVector& bindingState = vaoState.bindingState;
     for (int i = 0; i < bindingState.size(); i++) {
         bindingState[i].effectiveStride = 16;
     }
@@ -279,8 +277,7 @@ void GLClientState::removeVertexArrayObject(GLuint name) {
               __FUNCTION__);
         return;
     }
-    if (m_vaoMap.find(name) ==
-        m_vaoMap.end()) {
+    if (!m_vaoMap.find(name)) {
         ALOGE("%s: ERROR: %u not found in VAO state!",
               __FUNCTION__, name);
         return;
@@ -289,8 +286,8 @@ void GLClientState::removeVertexArrayObject(GLuint name) {
 }
 
 void GLClientState::setVertexArrayObject(GLuint name) {
-    if (m_vaoMap.find(name) ==
-        m_vaoMap.end()) {
+    VAOState* vaoState = m_vaoMap.find(name);
+    if (!vaoState) {
         ALOGE("%s: ERROR: %u not found in VAO state!",
               __FUNCTION__, name);
         return;
@@ -302,12 +299,11 @@ void GLClientState::setVertexArrayObject(GLuint name) {
         return;
     }
 
-    m_currVaoState =
-        VAOStateRef(m_vaoMap.find(name));
+    m_currVaoState = VAOStateRef(name, vaoState);
 }
 
 bool GLClientState::isVertexArrayObject(GLuint vao) const {
-    return m_vaoMap.find(vao) != m_vaoMap.end();
+    return m_vaoMap.find(vao) != NULL;
 }
 
 void GLClientState::getVBOUsage(bool* hasClientArrays, bool* hasVBOs) {
@@ -827,31 +823,37 @@ int GLClientState::bindBuffer(GLenum target, GLuint id)
     return err;
 }
 
+// ES3.x indexed binding points are only sized on the first bind to each
+// target, so that GLES2 contexts, and ES3 contexts that never touch them,
+// do not pay for them.
+GLClientState::BufferBinding& GLClientState::indexedBufferBinding(
+        std::vector<BufferBinding>& bindings, GLenum target, GLuint index) {
+    if (bindings.empty()) {
+        BufferBinding buf0Binding;
+        buf0Binding.buffer = 0;
+        buf0Binding.offset = 0;
+        buf0Binding.size = 0;
+        buf0Binding.stride = 0;
+        buf0Binding.effectiveStride = 0;
+        bindings.resize(getMaxIndexedBufferBindings(target), buf0Binding);
+    }
+    return bindings[index];
+}
+
 void GLClientState::bindIndexedBuffer(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size, GLintptr stride, GLintptr effectiveStride) {
+    std::vector<BufferBinding>* bindings;
     switch (target) {
     case GL_TRANSFORM_FEEDBACK_BUFFER:
-        m_indexedTransformFeedbackBuffers[index].buffer = buffer;
-        m_indexedTransformFeedbackBuffers[index].offset = offset;
-        m_indexedTransformFeedbackBuffers[index].size = size;
-        m_indexedTransformFeedbackBuffers[index].stride = stride;
+        bindings = &m_indexedTransformFeedbackBuffers;
         break;
     case GL_UNIFORM_BUFFER:
-        m_indexedUniformBuffers[index].buffer = buffer;
-        m_indexedUniformBuffers[index].offset = offset;
-        m_indexedUniformBuffers[index].size = size;
-        m_indexedUniformBuffers[index].stride = stride;
+        bindings = &m_indexedUniformBuffers;
         break;
     case GL_ATOMIC_COUNTER_BUFFER:
-        m_indexedAtomicCounterBuffers[index].buffer = buffer;
-        m_indexedAtomicCounterBuffers[index].offset = offset;
-        m_indexedAtomicCounterBuffers[index].size = size;
-        m_indexedAtomicCounterBuffers[index].stride = stride;
+        bindings = &m_indexedAtomicCounterBuffers;
         break;
     case GL_SHADER_STORAGE_BUFFER:
-        m_indexedShaderStorageBuffers[index].buffer = buffer;
-        m_indexedShaderStorageBuffers[index].offset = offset;
-        m_indexedShaderStorageBuffers[index].size = size;
-        m_indexedShaderStorageBuffers[index].stride = stride;
+        bindings = &m_indexedShaderStorageBuffers;
         break;
     default:
         m_currVaoState.bufferBinding(index).buffer = buffer;
@@ -862,18 +864,24 @@ void GLClientState::bindIndexedBuffer(GLenum target, GLuint index, GLuint buffer
         m_vaoAttribBindingCacheInvalid |= (1 << m_currVaoState.bufferBinding(index).vertexAttribLoc);
         return;
     }
+
+    BufferBinding& binding = indexedBufferBinding(*bindings, target, index);
+    binding.buffer = buffer;
+    binding.offset = offset;
+    binding.size = size;
+    binding.stride = stride;
 }
 
 int GLClientState::getMaxIndexedBufferBindings(GLenum target) const {
     switch (target) {
     case GL_TRANSFORM_FEEDBACK_BUFFER:
-        return m_indexedTransformFeedbackBuffers.size();
+        return m_glesMajorVersion >= 3 ? m_hostDriverCaps.max_transform_feedback_separate_attribs : 0;
     case GL_UNIFORM_BUFFER:
-        return m_indexedUniformBuffers.size();
+        return m_glesMajorVersion >= 3 ? m_hostDriverCaps.max_uniform_buffer_bindings : 0;
     case GL_ATOMIC_COUNTER_BUFFER:
-        return m_indexedAtomicCounterBuffers.size();
+        return m_glesMajorVersion >= 3 ? m_hostDriverCaps.max_atomic_counter_buffer_bindings : 0;
     case GL_SHADER_STORAGE_BUFFER:
-        return m_indexedShaderStorageBuffers.size();
+        return m_glesMajorVersion >= 3 ? m_hostDriverCaps.max_shader_storage_buffer_bindings : 0;
     default:
         return m_currVaoState.bufferBindings_const().size();
     }
@@ -898,22 +906,26 @@ bool GLClientState::isIndexedBindNoOp(GLenum target, GLuint index, GLuint buffer
 
     switch (target) {
     case GL_TRANSFORM_FEEDBACK_BUFFER:
-        return m_indexedTransformFeedbackBuffers[index].buffer == buffer &&
+        return !m_indexedTransformFeedbackBuffers.empty() &&
+               m_indexedTransformFeedbackBuffers[index].buffer == buffer &&
                m_indexedTransformFeedbackBuffers[index].offset == offset &&
                m_indexedTransformFeedbackBuffers[index].size == size &&
                m_indexedTransformFeedbackBuffers[index].stride == stride;
     case GL_UNIFORM_BUFFER:
-        return m_indexedUniformBuffers[index].buffer == buffer &&
+        return !m_indexedUniformBuffers.empty() &&
+               m_indexedUniformBuffers[index].buffer == buffer &&
                m_indexedUniformBuffers[index].offset == offset &&
                m_indexedUniformBuffers[index].size == size &&
                m_indexedUniformBuffers[index].stride == stride;
     case GL_ATOMIC_COUNTER_BUFFER:
-        return m_indexedAtomicCounterBuffers[index].buffer == buffer &&
+        return !m_indexedAtomicCounterBuffers.empty() &&
+               m_indexedAtomicCounterBuffers[index].buffer == buffer &&
                m_indexedAtomicCounterBuffers[index].offset == offset &&
                m_indexedAtomicCounterBuffers[index].size == size &&
                m_indexedAtomicCounterBuffers[index].stride == stride;
     case GL_SHADER_STORAGE_BUFFER:
-        return m_indexedShaderStorageBuffers[index].buffer == buffer &&
+        return !m_indexedShaderStorageBuffers.empty() &&
+               m_indexedShaderStorageBuffers[index].buffer == buffer &&
                m_indexedShaderStorageBuffers[index].offset == offset &&
                m_indexedShaderStorageBuffers[index].size == size &&
                m_indexedShaderStorageBuffers[index].stride == stride;
@@ -1057,6 +1069,12 @@ bool GLClientState::isTextureWithStorage(GLuint tex_name) const {
     return rec->hasStorage;
 }
 
+bool GLClientState::isTextureImmutable(GLuint tex_name) const {
+    TextureRec* rec = getTextureRec(tex_name);
+    if (!rec) return false;
+    return rec->immutable;
+}
+
 bool GLClientState::isTextureCubeMap(GLuint tex_name) const {
     TextureRec* texrec = getTextureRec(tex_name);
     if (!texrec) return false;
@@ -1513,7 +1531,8 @@ TextureRec* GLClientState::addTextureRec(GLuint id, GLenum target)
     tex->immutable = false;
     tex->boundEGLImage = false;
     tex->hasStorage = false;
-    tex->dims = new TextureDims[6];
+    // Only cube maps track per-face dimensions.
+    tex->dims = new TextureDims[target == GL_TEXTURE_CUBE_MAP ? 6 : 1];
     tex->hasCubeNegX = false;
     tex->hasCubePosX = false;
     tex->hasCubeNegY = false;
@@ -1584,7 +1603,7 @@ void GLClientState::setBoundTextureDims(GLenum target, GLenum cubetarget, GLsize
 
     size_t indexToSet = 0;
 
-    if (target == GL_TEXTURE_CUBE_MAP) {
+    if (target == GL_TEXTURE_CUBE_MAP && texrec->target == GL_TEXTURE_CUBE_MAP) {
         if (-1 == cubetarget) {
             setBoundTextureDims(target, GL_TEXTURE_CUBE_MAP_NEGATIVE_X, level, width, height, depth);
             setBoundTextureDims(target, GL_TEXTURE_CUBE_MAP_POSITIVE_X, level, width, height, depth);
@@ -1697,7 +1716,7 @@ bool GLClientState::isBoundTextureComplete(GLenum target) const {
     if (texrec->immutable) return true;
     if (!texrec->hasStorage) return true;
 
-    if (target == GL_TEXTURE_CUBE_MAP) {
+    if (target == GL_TEXTURE_CUBE_MAP && texrec->target == GL_TEXTURE_CUBE_MAP) {
         if (!(texrec->hasCubeNegX &&
              texrec->hasCubePosX &&
              texrec->hasCubeNegY &&
@@ -1705,13 +1724,13 @@ bool GLClientState::isBoundTextureComplete(GLenum target) const {
              texrec->hasCubeNegZ &&
              texrec->hasCubePosZ)) return false;
 
-        size_t currBaseLevel = texrec->dims[0].widths.begin()->first;
-        size_t currWidth = texrec->dims[0].widths.begin()->second;
-        size_t currHeight = texrec->dims[0].heights.begin()->second;
+        size_t currBaseLevel = texrec->dims[0].widths.baseLevel();
+        size_t currWidth = texrec->dims[0].widths.baseSize();
+        size_t currHeight = texrec->dims[0].heights.baseSize();
         for (size_t i = 1; i < 6; ++i) {
-            size_t nextLevel = texrec->dims[i].widths.begin()->first;
-            size_t nextWidth = texrec->dims[i].widths.begin()->second;
-            size_t nextHeight = texrec->dims[i].heights.begin()->second;
+            size_t nextLevel = texrec->dims[i].widths.baseLevel();
+            size_t nextWidth = texrec->dims[i].widths.baseSize();
+            size_t nextHeight = texrec->dims[i].heights.baseSize();
             if (currBaseLevel != nextLevel) return false;
             if (currWidth != nextWidth) return false;
             if (currHeight != nextHeight) return false;
@@ -2499,7 +2518,7 @@ void GLClientState::removeFramebuffers(GLsizei n, const GLuint* framebuffers) {
 }
 
 bool GLClientState::usedFramebufferName(GLuint name) const {
-    return mFboState.fboData.find(name) != mFboState.fboData.end();
+    return mFboState.fboData.find(name) != NULL;
 }
 
 FboProps& GLClientState::boundFboProps(GLenum target) {
@@ -2517,13 +2536,13 @@ FboProps& GLClientState::boundFboProps(GLenum target) {
 const FboProps& GLClientState::boundFboProps_const(GLenum target) const {
     switch (target) {
     case GL_DRAW_FRAMEBUFFER:
-        return mFboState.fboData.find(mFboState.boundDrawFramebuffer)->second;
+        return *mFboState.fboData.find(mFboState.boundDrawFramebuffer);
     case GL_READ_FRAMEBUFFER:
-        return mFboState.fboData.find(mFboState.boundReadFramebuffer)->second;
+        return *mFboState.fboData.find(mFboState.boundReadFramebuffer);
     case GL_FRAMEBUFFER:
-        return mFboState.fboData.find(mFboState.boundDrawFramebuffer)->second;
+        return *mFboState.fboData.find(mFboState.boundDrawFramebuffer);
     }
-    return mFboState.fboData.find(mFboState.boundDrawFramebuffer)->second;
+    return *mFboState.fboData.find(mFboState.boundDrawFramebuffer);
 }
 
 void GLClientState::bindFramebuffer(GLenum target, GLuint name) {
@@ -2787,14 +2806,12 @@ GLuint GLClientState::getFboAttachmentRboId(GLenum target, GLenum attachment) co
 }
 
 void GLClientState::setFboCompletenessDirtyForTexture(GLuint texture) {
-    std::map<GLuint, FboProps>::iterator it = mFboState.fboData.begin();
-    while (it != mFboState.fboData.end()) {
-        FboProps& props = it->second;
+    mFboState.fboData.forEach([&](GLuint, FboProps& props) {
         for (int i = 0; i < m_hostDriverCaps.max_color_attachments; ++i) {
             if (props.colorAttachmenti_hasTex[i]) {
                 if (texture == props.colorAttachmenti_textures[i]) {
                     props.completenessDirty = true;
-                    return;
+                    return false;
                 }
             }
         }
@@ -2802,36 +2819,34 @@ void GLClientState::setFboCompletenessDirtyForTexture(GLuint texture) {
         if (props.depthAttachment_hasTexObj) {
             if (texture == props.depthAttachment_texture) {
                     props.completenessDirty = true;
-                    return;
+                    return false;
             }
         }
 
         if (props.stencilAttachment_hasTexObj) {
             if (texture == props.stencilAttachment_texture) {
                 props.completenessDirty = true;
-                return;
+                return false;
             }
         }
 
         if (props.depthstencilAttachment_hasTexObj) {
             if (texture == props.depthstencilAttachment_texture) {
                 props.completenessDirty = true;
-                return;
+                return false;
             }
         }
-        ++it;
-    }
+        return true;
+    });
 }
 
 void GLClientState::setFboCompletenessDirtyForRbo(GLuint rbo) {
-    std::map<GLuint, FboProps>::iterator it = mFboState.fboData.begin();
-    while (it != mFboState.fboData.end()) {
-        FboProps& props = it->second;
+    mFboState.fboData.forEach([&](GLuint, FboProps& props) {
         for (int i = 0; i < m_hostDriverCaps.max_color_attachments; ++i) {
             if (props.colorAttachmenti_hasTex[i]) {
                 if (rbo == props.colorAttachmenti_rbos[i]) {
                     props.completenessDirty = true;
-                    return;
+                    return false;
                 }
             }
         }
@@ -2839,25 +2854,25 @@ void GLClientState::setFboCompletenessDirtyForRbo(GLuint rbo) {
         if (props.depthAttachment_hasTexObj) {
             if (rbo == props.depthAttachment_rbo) {
                     props.completenessDirty = true;
-                    return;
+                    return false;
             }
         }
 
         if (props.stencilAttachment_hasTexObj) {
             if (rbo == props.stencilAttachment_rbo) {
                 props.completenessDirty = true;
-                return;
+                return false;
             }
         }
 
         if (props.depthstencilAttachment_hasRbo) {
             if (rbo == props.depthstencilAttachment_rbo) {
                 props.completenessDirty = true;
-                return;
+                return false;
             }
         }
-        ++it;
-    }
+        return true;
+    });
 }
 
 bool GLClientState::attachmentHasObject(GLenum target, GLenum attachment) const {
@@ -3021,7 +3036,7 @@ bool GLClientState::compressedTexImageSizeCompatible(GLenum internalformat, GLsi
 }
 
 void GLClientState::fromMakeCurrent() {
-    if (mFboState.fboData.find(0) == mFboState.fboData.end()) {
+    if (!mFboState.fboData.find(0)) {
         addFreshFramebuffer(0);
     }
 
@@ -3053,44 +3068,49 @@ void GLClientState::initFromCaps(
         ++m_log2MaxTextureSize;
     }
 
-    if (m_glesMajorVersion >= 3) {
-        if (m_hostDriverCaps.max_transform_feedback_separate_attribs)
-            m_indexedTransformFeedbackBuffers.resize(m_hostDriverCaps.max_transform_feedback_separate_attribs);
-        if (m_hostDriverCaps.max_uniform_buffer_bindings)
-            m_indexedUniformBuffers.resize(m_hostDriverCaps.max_uniform_buffer_bindings);
-        if (m_hostDriverCaps.max_atomic_counter_buffer_bindings)
-            m_indexedAtomicCounterBuffers.resize(m_hostDriverCaps.max_atomic_counter_buffer_bindings);
-        if (m_hostDriverCaps.max_shader_storage_buffer_bindings)
-            m_indexedShaderStorageBuffers.resize(m_hostDriverCaps.max_shader_storage_buffer_bindings);
-
-        BufferBinding buf0Binding;
-        buf0Binding.buffer = 0;
-        buf0Binding.offset = 0;
-        buf0Binding.size = 0;
-        buf0Binding.stride = 0;
-        buf0Binding.effectiveStride = 0;
-
-        for (size_t i = 0; i < m_indexedTransformFeedbackBuffers.size(); ++i)
-            m_indexedTransformFeedbackBuffers[i] = buf0Binding;
-        for (size_t i = 0; i < m_indexedUniformBuffers.size(); ++i)
-            m_indexedUniformBuffers[i] = buf0Binding;
-        for (size_t i = 0; i < m_indexedAtomicCounterBuffers.size(); ++i)
-            m_indexedAtomicCounterBuffers[i] = buf0Binding;
-        for (size_t i = 0; i < m_indexedShaderStorageBuffers.size(); ++i)
-            m_indexedShaderStorageBuffers[i] = buf0Binding;
-    }
+    // Indexed buffer bindings are allocated on first use, see
+    // indexedBufferBinding().
 
     addFreshFramebuffer(0);
 
     m_initialized = true;
 }
 
+size_t GLClientState::getApproximateMemoryUsage() const {
+    size_t total = sizeof(*this);
+
+    total += m_vaoMap.size() *
+        (sizeof(VAOState) +
+         CODEC_MAX_VERTEX_ATTRIBUTES * (sizeof(VertexAttribState) + sizeof(BufferBinding)));
+
+    // Per-FBO color attachment vectors: textures, levels, layers and rbos,
+    // plus the two bit vectors.
+    total += mFboState.fboData.size() *
+        (sizeof(FboProps) +
+         m_hostDriverCaps.max_color_attachments *
+             (sizeof(GLuint) * 2 + sizeof(GLint) * 2) +
+         2 * ((m_hostDriverCaps.max_color_attachments + 7) / 8));
+
+    total += (m_indexedTransformFeedbackBuffers.capacity() +
+              m_indexedUniformBuffers.capacity() +
+              m_indexedAtomicCounterBuffers.capacity() +
+              m_indexedShaderStorageBuffers.capacity()) * sizeof(BufferBinding);
+
+    total += m_cubeMapDefs.size() * sizeof(CubeMapDef);
+    total += m_extensions.capacity();
+
+    return total;
+}
+
 bool GLClientState::needsInitFromCaps() const {
     return !m_initialized;
 }
 
 void GLClientState::setExtensions(const std::string& extensions) {
-    if (!m_extensions_set) m_extensions = extensions;
+    // The extensions of a context never change; this is called at every
+    // eglMakeCurrent.
+    if (m_extensions_set) return;
+    m_extensions = extensions;
 
     m_has_color_buffer_float_extension =
         hasExtension("GL_EXT_color_buffer_float");
@@ -26,6 +26,7 @@
 #include "StateTrackingSupport.h"
 #endif
 
+#include "DenseNameMap.h"
 #include "TextureSharedData.h"
 
 #include <GLES/gl.h>
@@ -209,20 +210,20 @@ public:
         int numAttributesNeedingUpdateForDraw;
     };
 
-    typedef std::map<GLuint, VAOState> VAOStateMap;
+    typedef DenseNameMap<VAOState> VAOStateMap;
     struct VAOStateRef {
-        VAOStateRef() { }
-        VAOStateRef(
-                VAOStateMap::iterator iter) : it(iter) { }
-        VAOState& vaoState() { return it->second; }
-        VertexAttribState& operator[](size_t k) { return it->second.attribState[k]; }
-        BufferBinding& bufferBinding(size_t k) { return it->second.bindingState[k]; }
-        VertexAttribBindingVector& bufferBindings() { return it->second.bindingState; }
-        const VertexAttribBindingVector& bufferBindings_const() const { return it->second.bindingState; }
-        GLuint vaoId() const { return it->first; }
-        GLuint& iboId() { return it->second.element_array_buffer_binding; }
-        GLuint& iboIdLastEncode() { return it->second.element_array_buffer_binding_lastEncode; }
-        VAOStateMap::iterator it;
+        VAOStateRef() : id(0), state(NULL) { }
+        VAOStateRef(GLuint vaoId, VAOState* vaoState) : id(vaoId), state(vaoState) { }
+        VAOState& vaoState() { return *state; }
+        VertexAttribState& operator[](size_t k) { return state->attribState[k]; }
+        BufferBinding& bufferBinding(size_t k) { return state->bindingState[k]; }
+        VertexAttribBindingVector& bufferBindings() { return state->bindingState; }
+        const VertexAttribBindingVector& bufferBindings_const() const { return state->bindingState; }
+        GLuint vaoId() const { return id; }
+        GLuint& iboId() { return state->element_array_buffer_binding; }
+        GLuint& iboIdLastEncode() { return state->element_array_buffer_binding_lastEncode; }
+        GLuint id;
+        VAOState* state;
     };
 
     typedef struct {
@@ -330,6 +331,15 @@ public:
     GLuint getLastEncodedBufferBind(GLenum target);
     void setLastEncodedBufferBind(GLenum target, GLuint id);
 
+    // GLES1: the client active texture is only sent along with vertex
+    // data; 0 until the first time.
+    GLenum getLastEncodedClientActiveTexture() const { return m_clientActiveTexture_lastEncode; }
+    void setLastEncodedClientActiveTexture(GLenum texture) { m_clientActiveTexture_lastEncode = texture; }
+    // GLES1: hidden buffer object that client arrays of |location| are
+    // promoted to, or 0 if none was created in this context yet.
+    GLuint getPromotedArrayBuffer(int location) const { return m_promotedArrayBuffers[location]; }
+    void setPromotedArrayBuffer(int location, GLuint buffer) { m_promotedArrayBuffers[location] = buffer; }
+
     size_t pixelDataSize(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, int pack) const;
     size_t pboNeededDataSize(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, int pack) const;
     size_t clearBufferNumElts(GLenum buffer) const;
@@ -534,6 +544,10 @@ public:
     void initFromCaps(
         const HostDriverCaps& caps);
     bool needsInitFromCaps() const;
+    // Rough heap footprint of this context's client state (not counting
+    // share group objects), to keep an eye on the per-context cost for apps
+    // that create many contexts.
+    size_t getApproximateMemoryUsage() const;
     void setExtensions(const std::string& extensions);
     bool hasExtension(const char* ext) const;
 
@@ -616,6 +630,8 @@ private:
     // GL_ARRAY_BUFFER_BINDING is separate from VAO state
     GLuint m_arrayBuffer;
     GLuint m_arrayBuffer_lastEncode;
+    GLenum m_clientActiveTexture_lastEncode;
+    GLuint m_promotedArrayBuffers[LAST_LOCATION];
     VAOStateMap m_vaoMap;
     VAOStateRef m_currVaoState;
 
@@ -649,6 +665,8 @@ private:
     std::string m_extensions;
     bool m_has_color_buffer_float_extension;
     bool m_has_color_buffer_half_float_extension;
+    BufferBinding& indexedBufferBinding(std::vector<BufferBinding>& bindings,
+                                        GLenum target, GLuint index);
     std::vector<BufferBinding> m_indexedTransformFeedbackBuffers;
     std::vector<BufferBinding> m_indexedUniformBuffers;
     std::vector<BufferBinding> m_indexedAtomicCounterBuffers;
@@ -724,7 +742,7 @@ private:
         GLuint boundDrawFramebuffer;
         GLuint boundReadFramebuffer;
         size_t boundFramebufferIndex;
-        std::map<GLuint, FboProps> fboData;
+        DenseNameMap<FboProps> fboData;
         GLenum drawFboCheckStatus;
         GLenum readFboCheckStatus;
     };
@@ -749,6 +767,7 @@ private:
 public:
     bool isTexture(GLuint name) const;
     bool isTextureWithStorage(GLuint name) const;
+    bool isTextureImmutable(GLuint name) const;
     bool isTextureWithTarget(GLuint name) const;
     bool isTextureCubeMap(GLuint name) const;
     bool isRenderbuffer(GLuint name) const;
@@ -17,14 +17,20 @@
 #include "GLSharedGroup.h"
 
 #include "KeyedVectorUtils.h"
+#include "ProgramBinaryCache.h"
 #include "glUtils.h"
 
+#include <algorithm>
+
 /**** BufferData ****/
 
-BufferData::BufferData() : m_size(0), m_usage(0), m_mapped(false) {};
+BufferData::BufferData() : m_size(0), m_usage(0), m_mapped(false),
+                           m_shadowFree(false), m_needsShadow(false),
+                           m_mapDirtyTracked(false) {};
 
 BufferData::BufferData(GLsizeiptr size, const void* data) :
-    m_size(size), m_usage(0), m_mapped(false) {
+    m_size(size), m_usage(0), m_mapped(false),
+    m_shadowFree(false), m_needsShadow(false), m_mapDirtyTracked(false) {
 
     if (size > 0) {
         m_fixedBuffer.resize(size);
@@ -57,6 +63,9 @@ void ProgramData::initProgramData(GLuint numIndexes, GLuint numAttributes) {
 
     m_Indexes = new IndexInfo[numIndexes];
     m_attribIndexes = new AttribInfo[m_numAttributes];
+
+    // Called on every successful (re)link; earlier lookups are stale.
+    clearCachedLocations();
 }
 
 bool ProgramData::isInitialized() {
@@ -185,6 +194,38 @@ bool ProgramData::setSamplerUniform(GLint appLoc, GLint val, GLenum* target) {
     return false;
 }
 
+bool ProgramData::getCachedLocation(
+    LocationType type, const char* name, GLint* location) const {
+
+    LocationMap::const_iterator it = m_locationCache[type].find(name);
+    if (it == m_locationCache[type].end()) return false;
+
+    *location = it->second;
+    return true;
+}
+
+void ProgramData::clearCachedLocations() {
+    for (int i = 0; i < 3; ++i) {
+        m_locationCache[i].clear();
+    }
+}
+
+void ProgramData::cacheLocation(
+    LocationType type, const std::string& name, GLint location) {
+
+    m_locationCache[type][name] = location;
+
+    // Active uniform/attrib arrays are reported as "name[0]"; "name" refers
+    // to the same location.
+    static const char kFirstElement[] = "[0]";
+    static const size_t kFirstElementLen = sizeof(kFirstElement) - 1;
+    if (type != LOCATION_UNIFORM_BLOCK &&
+        name.size() > kFirstElementLen &&
+        !name.compare(name.size() - kFirstElementLen, kFirstElementLen, kFirstElement)) {
+        m_locationCache[type][name.substr(0, name.size() - kFirstElementLen)] = location;
+    }
+}
+
 bool ProgramData::attachShader(GLuint shader, GLenum shaderType) {
     size_t n = m_shaders.size();
 
@@ -265,9 +306,44 @@ AttribValidationInfo ProgramData::compileAttribValidationInfo(bool* error) const
 }
 /***** GLSharedGroup ****/
 
-GLSharedGroup::GLSharedGroup() { }
+// Shadow storage pooling limits. Larger buffers are allocated exactly and
+// freed immediately.
+static const size_t kMinPooledBufferStorage = 256;
+static const size_t kMaxPooledBufferStorage = 1024 * 1024;
+static const size_t kMaxBufferStoragePoolBytes = 8 * 1024 * 1024;
+
+static size_t bufferStorageClass(size_t size) {
+    size_t sizeClass = kMinPooledBufferStorage;
+    while (sizeClass < size) sizeClass <<= 1;
+    return sizeClass;
+}
+
+namespace {
+
+// Brackets a lock-free read of the buffer table and of the BufferData it
+// returns. See GLSharedGroup::reclaimRetiredBuffersLocked().
+class BufferTableReadScope {
+public:
+    explicit BufferTableReadScope(std::atomic<uint32_t>& readers) : m_readers(readers) {
+        m_readers.fetch_add(1, std::memory_order_seq_cst);
+    }
+    ~BufferTableReadScope() {
+        m_readers.fetch_sub(1, std::memory_order_release);
+    }
+private:
+    std::atomic<uint32_t>& m_readers;
+};
+
+} // namespace
+
+GLSharedGroup::GLSharedGroup() :
+    m_bufferTableReaders(0),
+    m_bufferStoragePoolBytes(0), m_shadowFreeBufferBytes(0) { }
 
 GLSharedGroup::~GLSharedGroup() {
+    for (size_t i = 0; i < m_retiredBuffers.size(); ++i) {
+        delete m_retiredBuffers[i];
+    }
     m_buffers.clear();
     m_programs.clear();
     clearObjectMap(m_buffers);
@@ -286,6 +362,15 @@ bool GLSharedGroup::isShaderOrProgramObject(GLuint obj) {
 }
 
 BufferData* GLSharedGroup::getBufferData(GLuint bufferId) {
+    BufferTableReadScope scope(m_bufferTableReaders);
+    return lookupBufferData(bufferId);
+}
+
+// Callers that dereference the result without m_lock must hold a
+// BufferTableReadScope around the lookup and the dereference.
+BufferData* GLSharedGroup::lookupBufferData(GLuint bufferId) {
+    BufferData* buf;
+    if (m_bufferTable.lookup(bufferId, &buf)) return buf;
 
     android::AutoMutex _lock(m_lock);
 
@@ -304,22 +389,165 @@ SamplerInfo* GLSharedGroup::getSamplerInfo() {
     return &m_samplerInfo;
 }
 
+BufferData* GLSharedGroup::newBufferDataLocked(GLsizeiptr size, const void* data) {
+    if (size <= 0 || (size_t)size > kMaxPooledBufferStorage) {
+        return new BufferData(size, data);
+    }
+
+    BufferData* buf = new BufferData();
+    buf->m_size = size;
+
+    size_t sizeClass = bufferStorageClass(size);
+    std::vector<std::vector<char> >& bucket = m_bufferStoragePool[sizeClass];
+    if (!bucket.empty()) {
+        buf->m_fixedBuffer.swap(bucket.back());
+        bucket.pop_back();
+        m_bufferStoragePoolBytes -= sizeClass;
+    } else {
+        buf->m_fixedBuffer.reserve(sizeClass);
+    }
+
+    buf->m_fixedBuffer.resize(size);
+    if (data) {
+        memcpy(buf->m_fixedBuffer.data(), data, size);
+    } else {
+        memset(buf->m_fixedBuffer.data(), 0, size);
+    }
+
+    return buf;
+}
+
+void GLSharedGroup::deleteBufferDataLocked(BufferData* buf) {
+    if (buf->m_shadowFree) {
+        m_shadowFreeBufferBytes -= buf->m_size;
+    }
+
+    size_t capacity = buf->m_fixedBuffer.capacity();
+
+    if (capacity >= kMinPooledBufferStorage &&
+        capacity <= kMaxPooledBufferStorage &&
+        capacity == bufferStorageClass(capacity) &&
+        m_bufferStoragePoolBytes + capacity <= kMaxBufferStoragePoolBytes) {
+        m_bufferStoragePool[capacity].push_back(std::vector<char>());
+        m_bufferStoragePool[capacity].back().swap(buf->m_fixedBuffer);
+        m_bufferStoragePoolBytes += capacity;
+    }
+
+    delete buf;
+}
+
+void GLSharedGroup::retireBufferDataLocked(BufferData* buf) {
+    if (buf->m_shadowFree) {
+        m_shadowFreeBufferBytes -= buf->m_size;
+        buf->m_shadowFree = false;
+    }
+    m_retiredBuffers.push_back(buf);
+    reclaimRetiredBuffersLocked();
+}
+
+// A lock-free reader first registers in m_bufferTableReaders and then loads
+// from m_bufferTable; a writer first unpublishes from m_bufferTable and then
+// checks m_bufferTableReaders. All four are sequentially consistent, so if
+// the writer sees no readers, any reader that comes later loads the new
+// entry, and nothing can still refer to the retired BufferData.
+void GLSharedGroup::reclaimRetiredBuffersLocked() {
+    if (m_retiredBuffers.empty()) return;
+    if (m_bufferTableReaders.load(std::memory_order_seq_cst) != 0) return;
+
+    for (size_t i = 0; i < m_retiredBuffers.size(); ++i) {
+        deleteBufferDataLocked(m_retiredBuffers[i]);
+    }
+    m_retiredBuffers.clear();
+}
+
 void GLSharedGroup::addBufferData(GLuint bufferId, GLsizeiptr size, const void* data) {
 
     android::AutoMutex _lock(m_lock);
 
-    m_buffers[bufferId] = new BufferData(size, data);
+    BufferData* currentBuffer = findObjectOrDefault(m_buffers, bufferId);
+
+    m_buffers[bufferId] = newBufferDataLocked(size, data);
+    m_bufferTable.set(bufferId, m_buffers[bufferId]);
+
+    if (currentBuffer) retireBufferDataLocked(currentBuffer);
 }
 
-void GLSharedGroup::updateBufferData(GLuint bufferId, GLsizeiptr size, const void* data) {
+void GLSharedGroup::updateBufferData(GLuint bufferId, GLsizeiptr size, const void* data,
+                                     bool shadowFree) {
 
     android::AutoMutex _lock(m_lock);
 
     BufferData* currentBuffer = findObjectOrDefault(m_buffers, bufferId);
+    bool needsShadow = currentBuffer && currentBuffer->m_needsShadow;
+
+    // Same-size re-specification, most commonly orphaning with
+    // glBufferData(NULL) every frame: keep the existing shadow. Contents are
+    // undefined after orphaning, so there is nothing to clear.
+    if (currentBuffer && currentBuffer->m_size == size &&
+        !currentBuffer->m_shadowFree && !shadowFree) {
+        currentBuffer->m_mapped = false;
+        currentBuffer->m_mappedAccess = 0;
+        currentBuffer->m_mappedOffset = 0;
+        currentBuffer->m_mappedLength = 0;
+        currentBuffer->m_indexRangeCache.clear();
+        currentBuffer->m_mapDirtyTracked = false;
+        currentBuffer->m_mapSnapshot.clear();
+        if (data && size > 0) {
+            memcpy(currentBuffer->m_fixedBuffer.data(), data, size);
+        }
+        return;
+    }
+
+    BufferData* buf;
+    if (shadowFree) {
+        buf = new BufferData();
+        buf->m_size = size;
+        buf->m_shadowFree = true;
+        m_shadowFreeBufferBytes += size;
+    } else {
+        buf = newBufferDataLocked(size, data);
+    }
+    buf->m_needsShadow = needsShadow;
+    m_buffers[bufferId] = buf;
+    // Publish the replacement before retiring the old one, so that a
+    // lock-free reader never loads a pointer that is already retired.
+    m_bufferTable.set(bufferId, buf);
+
+    if (currentBuffer) retireBufferDataLocked(currentBuffer);
+}
+
+void GLSharedGroup::setBufferShadowFree(GLuint bufferId, bool shadowFree) {
+
+    android::AutoMutex _lock(m_lock);
 
-    if (currentBuffer) delete currentBuffer;
+    BufferData* buf = findObjectOrDefault(m_buffers, bufferId);
+    if (!buf || buf->m_shadowFree == shadowFree) return;
+
+    if (shadowFree) {
+        std::vector<char>().swap(buf->m_fixedBuffer);
+        buf->m_indexRangeCache.clear();
+        m_shadowFreeBufferBytes += buf->m_size;
+    } else {
+        buf->m_fixedBuffer.resize(buf->m_size);
+        m_shadowFreeBufferBytes -= buf->m_size;
+    }
+
+    buf->m_shadowFree = shadowFree;
+}
+
+void GLSharedGroup::setBufferNeedsShadow(GLuint bufferId) {
+
+    android::AutoMutex _lock(m_lock);
+
+    BufferData* buf = findObjectOrDefault(m_buffers, bufferId);
+    if (buf) buf->m_needsShadow = true;
+}
+
+size_t GLSharedGroup::getShadowFreeBufferBytes() {
+
+    android::AutoMutex _lock(m_lock);
 
-    m_buffers[bufferId] = new BufferData(size, data);
+    return m_shadowFreeBufferBytes;
 }
 
 void GLSharedGroup::setBufferUsage(GLuint bufferId, GLenum usage) {
@@ -332,7 +560,8 @@ void GLSharedGroup::setBufferUsage(GLuint bufferId, GLenum usage) {
 }
 
 void GLSharedGroup::setBufferMapped(GLuint bufferId, bool mapped) {
-    BufferData* buf = findObjectOrDefault(m_buffers, bufferId);
+    BufferTableReadScope scope(m_bufferTableReaders);
+    BufferData* buf = lookupBufferData(bufferId);
 
     if (!buf) return;
 
@@ -340,7 +569,8 @@ void GLSharedGroup::setBufferMapped(GLuint bufferId, bool mapped) {
 }
 
 GLenum GLSharedGroup::getBufferUsage(GLuint bufferId) {
-    BufferData* buf = findObjectOrDefault(m_buffers, bufferId);
+    BufferTableReadScope scope(m_bufferTableReaders);
+    BufferData* buf = lookupBufferData(bufferId);
 
     if (!buf) return 0;
 
@@ -348,7 +578,8 @@ GLenum GLSharedGroup::getBufferUsage(GLuint bufferId) {
 }
 
 bool GLSharedGroup::isBufferMapped(GLuint bufferId) {
-    BufferData* buf = findObjectOrDefault(m_buffers, bufferId);
+    BufferTableReadScope scope(m_bufferTableReaders);
+    BufferData* buf = lookupBufferData(bufferId);
 
     if (!buf) return false;
 
@@ -365,7 +596,9 @@ GLenum GLSharedGroup::subUpdateBufferData(GLuint bufferId, GLintptr offset, GLsi
         return GL_INVALID_VALUE;
     }
 
-    memcpy(&buf->m_fixedBuffer[offset], data, size);
+    if (!buf->m_shadowFree) {
+        memcpy(&buf->m_fixedBuffer[offset], data, size);
+    }
 
     buf->m_indexRangeCache.invalidateRange((size_t)offset, (size_t)size);
     return GL_NO_ERROR;
@@ -377,8 +610,9 @@ void GLSharedGroup::deleteBufferData(GLuint bufferId) {
 
     BufferData* buf = findObjectOrDefault(m_buffers, bufferId);
     if (buf) {
-        delete buf;
+        m_bufferTable.clear(bufferId);
         m_buffers.erase(bufferId);
+        retireBufferDataLocked(buf);
     }
 }
 
@@ -532,6 +766,7 @@ void GLSharedGroup::setProgramIndexInfo(
 
     if (pData) {
         pData->setIndexInfo(index,base,size,type);
+        pData->cacheLocation(ProgramData::LOCATION_UNIFORM, name, base);
         if (type == GL_SAMPLER_2D) {
             size_t n = pData->getNumShaders();
             for (size_t i = 0; i < n; i++) {
@@ -566,6 +801,7 @@ void GLSharedGroup::setProgramAttribInfo(
 
     if (pData) {
         pData->setAttribInfo(index,attribLoc,size,type);
+        pData->cacheLocation(ProgramData::LOCATION_ATTRIB, name, attribLoc);
     }
 }
 
@@ -816,6 +1052,7 @@ void GLSharedGroup::setShaderProgramIndexInfo(
     ShaderData& sData = spData->shaderData;
 
     pData.setIndexInfo(index, base, size, type);
+    pData.cacheLocation(ProgramData::LOCATION_UNIFORM, name, base);
 
     if (type == GL_SAMPLER_2D) {
 
@@ -932,3 +1169,99 @@ int GLSharedGroup::getActiveAttributesCountForProgram(GLuint program) {
     return pData->getActiveAttributesCount();
 }
 
+bool GLSharedGroup::getProgramCachedLocation(
+    GLuint program, ProgramData::LocationType type,
+    const char* name, GLint* location) {
+
+    android::AutoMutex _lock(m_lock);
+    ProgramData* pData = getProgramDataLocked(program);
+    if (!pData) return false;
+    return pData->getCachedLocation(type, name, location);
+}
+
+void GLSharedGroup::setProgramCachedLocation(
+    GLuint program, ProgramData::LocationType type,
+    const char* name, GLint location) {
+
+    android::AutoMutex _lock(m_lock);
+    ProgramData* pData = getProgramDataLocked(program);
+    if (!pData) return;
+    pData->cacheLocation(type, name, location);
+}
+
+void GLSharedGroup::clearProgramCachedLocations(GLuint program) {
+
+    android::AutoMutex _lock(m_lock);
+    ProgramData* pData = getProgramDataLocked(program);
+    if (!pData) return;
+    pData->clearCachedLocations();
+}
+
+void GLSharedGroup::setProgramLinkInput(GLuint program, const std::string& setting,
+                                        const std::string& value) {
+    android::AutoMutex _lock(m_lock);
+    ProgramData* pData = findObjectOrDefault(m_programs, program);
+    if (!pData) return;
+    pData->setLinkInput(setting, value);
+}
+
+bool GLSharedGroup::getProgramLinkKey(GLuint program, uint64_t* key) {
+    android::AutoMutex _lock(m_lock);
+    ProgramData* pData = findObjectOrDefault(m_programs, program);
+    if (!pData || !pData->getNumShaders()) return false;
+
+    // Attachment order does not matter to the link; shader types are
+    // unique per program, so order by type.
+    std::vector<std::pair<GLenum, ShaderData*> > shaders;
+    for (size_t i = 0; i < pData->getNumShaders(); ++i) {
+        ShaderData* sData = findObjectOrDefault(m_shaders, pData->getShader(i));
+        if (!sData || !sData->compiled) return false;
+        shaders.push_back(std::make_pair(sData->shaderType, sData));
+    }
+    std::sort(shaders.begin(), shaders.end());
+
+    uint64_t h = ProgramBinaryCache::hashInit();
+    for (size_t i = 0; i < shaders.size(); ++i) {
+        const ShaderData* sData = shaders[i].second;
+        uint32_t type = sData->shaderType;
+        uint32_t count = sData->compiledSources.size();
+        h = ProgramBinaryCache::hash(h, &type, sizeof(type));
+        h = ProgramBinaryCache::hash(h, &count, sizeof(count));
+        for (size_t j = 0; j < sData->compiledSources.size(); ++j) {
+            const std::string& src = sData->compiledSources[j];
+            uint32_t len = src.size();
+            h = ProgramBinaryCache::hash(h, &len, sizeof(len));
+            h = ProgramBinaryCache::hash(h, src.data(), src.size());
+        }
+    }
+
+    const ProgramData::LinkInputMap& linkInputs = pData->getLinkInputs();
+    for (ProgramData::LinkInputMap::const_iterator it = linkInputs.begin();
+         it != linkInputs.end(); ++it) {
+        uint32_t lens[2] = { (uint32_t)it->first.size(), (uint32_t)it->second.size() };
+        h = ProgramBinaryCache::hash(h, lens, sizeof(lens));
+        h = ProgramBinaryCache::hash(h, it->first.data(), it->first.size());
+        h = ProgramBinaryCache::hash(h, it->second.data(), it->second.size());
+    }
+
+    *key = h;
+    return true;
+}
+
+std::vector<GLuint> GLSharedGroup::takePendingShaderCompiles(GLuint program) {
+    std::vector<GLuint> res;
+
+    android::AutoMutex _lock(m_lock);
+    ProgramData* pData = findObjectOrDefault(m_programs, program);
+    if (!pData) return res;
+
+    for (size_t i = 0; i < pData->getNumShaders(); ++i) {
+        ShaderData* sData = findObjectOrDefault(m_shaders, pData->getShader(i));
+        if (sData && sData->compilePending) {
+            sData->compilePending = false;
+            res.push_back(pData->getShader(i));
+        }
+    }
+
+    return res;
+}
@@ -29,9 +29,11 @@
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <stdio.h>
@@ -40,6 +42,7 @@
 #include <utils/threads.h>
 #include "auto_goldfish_dma_context.h"
 #include "IndexRangeCache.h"
+#include "ReadMostlyNameTable.h"
 #include "StateTrackingSupport.h"
 
 struct BufferData {
@@ -60,6 +63,17 @@ struct BufferData {
     // Internal bookkeeping
     std::vector<char> m_fixedBuffer; // actual buffer is shadowed here
     IndexRangeCache m_indexRangeCache;
+    // Shadow-free buffers keep no guest copy (m_fixedBuffer is empty); the
+    // shadow is fetched from the host if it is ever needed. m_needsShadow
+    // records that the buffer was used as an index buffer or mapped for
+    // reading, which disqualifies it from going shadow-free again.
+    bool m_shadowFree;
+    bool m_needsShadow;
+    // Copy of the mapped range taken at map time, so that unmap can tell
+    // which pages were actually written. Only taken (m_mapDirtyTracked) if
+    // the shadow was known to match the host when the map began.
+    bool m_mapDirtyTracked;
+    std::vector<char> m_mapSnapshot;
 
     // DMA support
     AutoGoldfishDmaContext dma_buffer;
@@ -97,11 +111,29 @@ private:
     uint32_t m_activeUniformBlockCount;
     uint32_t m_transformFeedbackVaryingsCount;;
 
+    // Name lookups answered so far for the current link, so that repeated
+    // glGet*Location calls do not round trip to the host.
+    typedef std::unordered_map<std::string, GLint> LocationMap;
+    LocationMap m_locationCache[3];
+
+    // Everything besides the shaders that affects the result of a link
+    // (attribute bindings, transform feedback varyings, ...), by setting:
+    // a later call for the same setting replaces the earlier one, so this
+    // stays as small as the program's state. Used to key the program
+    // binary cache.
+    std::map<std::string, std::string> m_linkInputs;
+
 public:
     enum {
         INDEX_FLAG_SAMPLER_EXTERNAL = 0x00000001,
     };
 
+    enum LocationType {
+        LOCATION_UNIFORM = 0,
+        LOCATION_ATTRIB = 1,
+        LOCATION_UNIFORM_BLOCK = 2,
+    };
+
     ProgramData();
     void initProgramData(GLuint numIndexes, GLuint numAttributes);
     bool isInitialized();
@@ -148,6 +180,16 @@ public:
         return m_transformFeedbackVaryingsCount;
     }
 
+    bool getCachedLocation(LocationType type, const char* name, GLint* location) const;
+    void cacheLocation(LocationType type, const std::string& name, GLint location);
+    void clearCachedLocations();
+
+    typedef std::map<std::string, std::string> LinkInputMap;
+    void setLinkInput(const std::string& setting, const std::string& value) {
+        m_linkInputs[setting] = value;
+    }
+    const LinkInputMap& getLinkInputs() const { return m_linkInputs; }
+
     GLuint getActiveUniformsCount() const {
         return m_numIndexes;
     }
@@ -163,6 +205,13 @@ struct ShaderData {
     int refcount;
     std::vector<std::string> sources;
     GLenum shaderType;
+
+    // Program binary cache support: the sources as of the last
+    // glCompileShader, and whether that compile has been deferred and
+    // still needs to be sent to the host.
+    std::vector<std::string> compiledSources;
+    bool compiled = false;
+    bool compilePending = false;
 };
 
 class ShaderProgramData {
@@ -175,6 +224,14 @@ class GLSharedGroup {
 private:
     SharedTextureDataMap m_textureRecs;
     std::map<GLuint, BufferData*> m_buffers;
+    // Lock-free mirror of m_buffers for the per-draw/per-bind lookups.
+    // Updated under m_lock alongside m_buffers.
+    ReadMostlyNameTable<BufferData> m_bufferTable;
+    // Lock-free readers of m_bufferTable in flight. A BufferData that has
+    // been unpublished from the table is only freed once this drops to
+    // zero; until then it waits in m_retiredBuffers.
+    std::atomic<uint32_t> m_bufferTableReaders;
+    std::vector<BufferData*> m_retiredBuffers;
     std::map<GLuint, ProgramData*> m_programs;
     std::map<GLuint, ShaderData*> m_shaders;
     std::map<uint32_t, ShaderProgramData*> m_shaderPrograms;
@@ -189,6 +246,21 @@ private:
 
     uint32_t m_shaderProgramId;
 
+    // Recycled BufferData shadow storage, bucketed by power-of-two
+    // capacity, so that buffers re-specified with a different size every
+    // frame do not hit the allocator.
+    std::map<size_t, std::vector<std::vector<char> > > m_bufferStoragePool;
+    size_t m_bufferStoragePoolBytes;
+    // Guest memory not spent on shadows of shadow-free buffers.
+    size_t m_shadowFreeBufferBytes;
+
+    BufferData* newBufferDataLocked(GLsizeiptr size, const void* data);
+    BufferData* lookupBufferData(GLuint bufferId);
+    void deleteBufferDataLocked(BufferData* buf);
+    // |buf| must already be unpublished from m_bufferTable.
+    void retireBufferDataLocked(BufferData* buf);
+    void reclaimRetiredBuffersLocked();
+
     ProgramData* getProgramDataLocked(GLuint program);
 public:
     GLSharedGroup();
@@ -199,7 +271,13 @@ public:
     RenderbufferInfo* getRenderbufferInfo();
     SamplerInfo* getSamplerInfo();
     void    addBufferData(GLuint bufferId, GLsizeiptr size, const void* data);
-    void    updateBufferData(GLuint bufferId, GLsizeiptr size, const void* data);
+    void    updateBufferData(GLuint bufferId, GLsizeiptr size, const void* data,
+                             bool shadowFree = false);
+    // Drops or (re)allocates the guest shadow of a buffer. Reallocated
+    // shadows are zero-filled; the caller fetches the contents from the host.
+    void    setBufferShadowFree(GLuint bufferId, bool shadowFree);
+    void    setBufferNeedsShadow(GLuint bufferId);
+    size_t  getShadowFreeBufferBytes();
     void    setBufferUsage(GLuint bufferId, GLenum usage);
     void    setBufferMapped(GLuint bufferId, bool mapped);
     GLenum    getBufferUsage(GLuint bufferId);
@@ -256,6 +334,23 @@ public:
 
     int getActiveUniformsCountForProgram(GLuint program);
     int getActiveAttributesCountForProgram(GLuint program);
+
+    // Name to location/index lookups, valid until the program is relinked
+    bool getProgramCachedLocation(GLuint program, ProgramData::LocationType type,
+                                  const char* name, GLint* location);
+    void setProgramCachedLocation(GLuint program, ProgramData::LocationType type,
+                                  const char* name, GLint location);
+    void clearProgramCachedLocations(GLuint program);
+
+    // Program binary cache support
+    void setProgramLinkInput(GLuint program, const std::string& setting,
+                             const std::string& value);
+    // Returns false if the program cannot be keyed, e.g. because one of its
+    // shaders was never compiled.
+    bool getProgramLinkKey(GLuint program, uint64_t* key);
+    // Returns the attached shaders whose compile was deferred, clearing
+    // their pending state.
+    std::vector<GLuint> takePendingShaderCompiles(GLuint program);
 };
 
 typedef std::shared_ptr<GLSharedGroup> GLSharedGroupPtr;
@@ -0,0 +1,288 @@
+/*
+* Copyright (C) 2021 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "ProgramBinaryCache.h"
+
+#include <atomic>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if PLATFORM_SDK_VERSION < 26
+#include <cutils/log.h>
+#else
+#include <log/log.h>
+#endif
+
+static const uint32_t kCacheFileMagic = 0x43425047; // "GPBC"
+static const uint32_t kCacheFileVersion = 1;
+
+// Cache files are per process, named after the process so that apps sharing
+// a cache directory do not overwrite each other's binaries.
+static std::string getProcessCacheName() {
+    std::string name;
+    FILE* f = fopen("/proc/self/cmdline", "r");
+    if (f) {
+        char buf[256] = {};
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        name.assign(buf, strnlen(buf, n));
+    }
+
+    for (size_t i = 0; i < name.size(); ++i) {
+        char c = name[i];
+        if (c == '/' || c == ':' || c == ' ') name[i] = '_';
+    }
+
+    if (name.empty()) name = "default";
+    return name;
+}
+
+static uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static android::Mutex sProcessCacheLock;
+static std::atomic<ProgramBinaryCache*> sProcessCache(NULL);
+static std::string sProcessCacheDir;
+
+// static
+ProgramBinaryCache* ProgramBinaryCache::get(const std::string& dir,
+                                            const std::string& rendererKey) {
+    android::AutoMutex _lock(sProcessCacheLock);
+
+    ProgramBinaryCache* cache = sProcessCache.load();
+    if (!cache) {
+        cache = new ProgramBinaryCache(dir + "/" + getProcessCacheName() + ".progbin",
+                                       rendererKey);
+        sProcessCacheDir = dir;
+        sProcessCache.store(cache);
+        return cache;
+    }
+
+    if (dir != sProcessCacheDir || rendererKey != cache->m_rendererKey) {
+        ALOGW("%s: cache already opened in %s for '%s', not using it for %s, '%s'\n",
+              __FUNCTION__, sProcessCacheDir.c_str(), cache->m_rendererKey.c_str(),
+              dir.c_str(), rendererKey.c_str());
+        return NULL;
+    }
+    return cache;
+}
+
+// static
+void ProgramBinaryCache::flushProcessCache() {
+    ProgramBinaryCache* cache = sProcessCache.load();
+    if (cache) cache->flush();
+}
+
+// static
+void ProgramBinaryCache::flushProcessCacheIfDue() {
+    ProgramBinaryCache* cache = sProcessCache.load();
+    if (!cache) return;
+
+    uint64_t dirtySinceNs = cache->m_dirtySinceNs.load(std::memory_order_relaxed);
+    if (!dirtySinceNs || monotonicNs() - dirtySinceNs < kFlushDelayNs) return;
+
+    cache->flush();
+}
+
+// static
+uint64_t ProgramBinaryCache::hash(uint64_t h, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+ProgramBinaryCache::ProgramBinaryCache(const std::string& path,
+                                       const std::string& rendererKey) :
+    m_path(path),
+    m_rendererKey(rendererKey),
+    m_loaded(false),
+    m_dirtySinceNs(0),
+    m_seqno(0),
+    m_totalSize(0) { }
+
+bool ProgramBinaryCache::lookup(uint64_t key, GLenum* format, std::vector<char>* binary) {
+    android::AutoMutex _lock(m_lock);
+    loadLocked();
+
+    std::map<uint64_t, Entry>::iterator it = m_entries.find(key);
+    if (it == m_entries.end()) return false;
+
+    *format = it->second.format;
+    *binary = it->second.binary;
+    return true;
+}
+
+void ProgramBinaryCache::insert(uint64_t key, GLenum format, const void* binary, size_t size) {
+    if (!size || size > kMaxEntrySize) return;
+
+    android::AutoMutex _lock(m_lock);
+    loadLocked();
+
+    addEntryLocked(key, format, (const char*)binary, size);
+    markDirtyLocked();
+}
+
+void ProgramBinaryCache::evict(uint64_t key) {
+    android::AutoMutex _lock(m_lock);
+
+    std::map<uint64_t, Entry>::iterator it = m_entries.find(key);
+    if (it == m_entries.end()) return;
+
+    m_totalSize -= it->second.binary.size();
+    m_entries.erase(it);
+    markDirtyLocked();
+}
+
+void ProgramBinaryCache::flush() {
+    android::AutoMutex _lock(m_lock);
+    if (!m_dirtySinceNs.load(std::memory_order_relaxed)) return;
+
+    storeLocked();
+    m_dirtySinceNs.store(0, std::memory_order_relaxed);
+}
+
+void ProgramBinaryCache::markDirtyLocked() {
+    if (!m_dirtySinceNs.load(std::memory_order_relaxed)) {
+        m_dirtySinceNs.store(monotonicNs(), std::memory_order_relaxed);
+    }
+}
+
+void ProgramBinaryCache::addEntryLocked(uint64_t key, GLenum format, const char* data, size_t size) {
+    std::map<uint64_t, Entry>::iterator it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        m_totalSize -= it->second.binary.size();
+        m_entries.erase(it);
+    }
+
+    while (!m_entries.empty() && m_totalSize + size > kMaxTotalSize) {
+        evictOldestLocked();
+    }
+
+    Entry& entry = m_entries[key];
+    entry.format = format;
+    entry.seqno = m_seqno++;
+    entry.binary.assign(data, data + size);
+    m_totalSize += size;
+}
+
+void ProgramBinaryCache::evictOldestLocked() {
+    std::map<uint64_t, Entry>::iterator oldest = m_entries.begin();
+    for (std::map<uint64_t, Entry>::iterator it = m_entries.begin();
+         it != m_entries.end(); ++it) {
+        if (it->second.seqno < oldest->second.seqno) oldest = it;
+    }
+    m_totalSize -= oldest->second.binary.size();
+    m_entries.erase(oldest);
+}
+
+// File layout (host endianness; the file never leaves the device):
+//   u32 magic, u32 version, u32 rendererKeyLen, rendererKey bytes,
+//   u32 entryCount, then per entry: u64 key, u32 format, u32 size, bytes.
+void ProgramBinaryCache::loadLocked() {
+    if (m_loaded) return;
+    m_loaded = true;
+
+    FILE* f = fopen(m_path.c_str(), "rb");
+    if (!f) return;
+
+    uint32_t header[3];
+    if (fread(header, sizeof(header), 1, f) != 1 ||
+        header[0] != kCacheFileMagic ||
+        header[1] != kCacheFileVersion ||
+        header[2] != m_rendererKey.size()) {
+        fclose(f);
+        return;
+    }
+
+    std::string rendererKey(header[2], '\0');
+    if (header[2] && fread(&rendererKey[0], header[2], 1, f) != 1) {
+        fclose(f);
+        return;
+    }
+
+    if (rendererKey != m_rendererKey) {
+        ALOGD("%s: host renderer changed, discarding %s\n", __func__, m_path.c_str());
+        fclose(f);
+        return;
+    }
+
+    uint32_t count = 0;
+    if (fread(&count, sizeof(count), 1, f) != 1) {
+        fclose(f);
+        return;
+    }
+
+    std::vector<char> data;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint64_t key;
+        uint32_t info[2]; // format, size
+        if (fread(&key, sizeof(key), 1, f) != 1 ||
+            fread(info, sizeof(info), 1, f) != 1 ||
+            !info[1] || info[1] > kMaxEntrySize) {
+            break;
+        }
+        data.resize(info[1]);
+        if (fread(data.data(), info[1], 1, f) != 1) break;
+        addEntryLocked(key, info[0], data.data(), info[1]);
+    }
+
+    fclose(f);
+}
+
+void ProgramBinaryCache::storeLocked() {
+    // Write to a temporary file and rename, so that a concurrent reader or a
+    // crash never observes a partially written cache.
+    std::string tmpPath = m_path + ".tmp";
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f) {
+        ALOGW("%s: cannot open %s for writing\n", __func__, tmpPath.c_str());
+        return;
+    }
+
+    uint32_t header[3] = {
+        kCacheFileMagic, kCacheFileVersion, (uint32_t)m_rendererKey.size(),
+    };
+    uint32_t count = (uint32_t)m_entries.size();
+
+    bool ok =
+        fwrite(header, sizeof(header), 1, f) == 1 &&
+        (m_rendererKey.empty() ||
+         fwrite(m_rendererKey.data(), m_rendererKey.size(), 1, f) == 1) &&
+        fwrite(&count, sizeof(count), 1, f) == 1;
+
+    for (std::map<uint64_t, Entry>::const_iterator it = m_entries.begin();
+         ok && it != m_entries.end(); ++it) {
+        uint32_t info[2] = { it->second.format, (uint32_t)it->second.binary.size() };
+        ok = fwrite(&it->first, sizeof(it->first), 1, f) == 1 &&
+             fwrite(info, sizeof(info), 1, f) == 1 &&
+             fwrite(it->second.binary.data(), info[1], 1, f) == 1;
+    }
+
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmpPath.c_str(), m_path.c_str())) {
+        ALOGW("%s: failed to write %s\n", __func__, m_path.c_str());
+        remove(tmpPath.c_str());
+    }
+}
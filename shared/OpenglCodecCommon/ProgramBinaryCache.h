@@ -0,0 +1,102 @@
+/*
+* Copyright (C) 2021 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _GL_PROGRAM_BINARY_CACHE_H_
+#define _GL_PROGRAM_BINARY_CACHE_H_
+
+#include <GLES2/gl2.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <utils/threads.h>
+
+// Process-wide, on-disk cache of linked program binaries.
+//
+// Entries are keyed by a hash of everything that goes into a link (shader
+// types and sources, attribute bindings, transform feedback varyings, ...),
+// computed by GLSharedGroup::getProgramLinkKey(). The cache file is tagged
+// with the host renderer, and is discarded as a whole if the renderer no
+// longer matches, since binaries are only valid for the driver that produced
+// them.
+//
+// Changes are only kept in memory until flush() writes them out, so that
+// links do not each rewrite the file. EGL flushes from eglSwapBuffers once
+// the cache has been dirty for kFlushDelayNs, which lets a burst of links at
+// startup go out in one write, and again at context teardown and
+// eglTerminate.
+class ProgramBinaryCache {
+public:
+    // Largest single binary we are willing to keep.
+    static const size_t kMaxEntrySize = 1 * 1024 * 1024;
+    // Once the cache grows beyond this, the oldest entries are evicted.
+    static const size_t kMaxTotalSize = 16 * 1024 * 1024;
+    // How long changes may stay unwritten before the next swap flushes them.
+    static const uint64_t kFlushDelayNs = 2000000000ULL;
+
+    // Returns the process-wide cache, stored in |dir| and valid for
+    // |rendererKey|. The first call determines both. A later call with a
+    // different |dir| or |rendererKey| returns NULL, since binaries from one
+    // renderer must not be offered to another, and the caller runs without
+    // a cache.
+    static ProgramBinaryCache* get(const std::string& dir,
+                                   const std::string& rendererKey);
+    // Flushes the process-wide cache, if one was created.
+    static void flushProcessCache();
+    // Flushes the process-wide cache if it has been dirty for at least
+    // kFlushDelayNs. Cheap enough to call every frame.
+    static void flushProcessCacheIfDue();
+
+    bool lookup(uint64_t key, GLenum* format, std::vector<char>* binary);
+    void insert(uint64_t key, GLenum format, const void* binary, size_t size);
+    void evict(uint64_t key);
+    // Writes the cache file if anything changed since the last write.
+    void flush();
+
+    // FNV-1a, used to build link keys.
+    static uint64_t hashInit() { return 0xcbf29ce484222325ULL; }
+    static uint64_t hash(uint64_t h, const void* data, size_t size);
+
+private:
+    ProgramBinaryCache(const std::string& path, const std::string& rendererKey);
+
+    void markDirtyLocked();
+    void loadLocked();
+    void storeLocked();
+    void addEntryLocked(uint64_t key, GLenum format, const char* data, size_t size);
+    void evictOldestLocked();
+
+    struct Entry {
+        GLenum format;
+        uint64_t seqno;
+        std::vector<char> binary;
+    };
+
+    android::Mutex m_lock;
+    std::string m_path;
+    std::string m_rendererKey;
+    bool m_loaded;
+    // Monotonic time at which the cache became dirty, or 0 if it is clean.
+    // Atomic so that flushProcessCacheIfDue() can check it without m_lock.
+    std::atomic<uint64_t> m_dirtySinceNs;
+    uint64_t m_seqno;
+    size_t m_totalSize;
+    std::map<uint64_t, Entry> m_entries;
+};
+
+#endif
@@ -0,0 +1,113 @@
+/*
+* Copyright (C) 2021 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Dense, name-indexed table of object pointers that can be read without
+// taking a lock.
+//
+// Writers (set/clear) must be serialized by the caller. Readers only do two
+// loads. All entry loads and stores are sequentially consistent, so that a
+// writer that replaces or clears an entry and then observes no active
+// readers (see GLSharedGroup) knows no reader can still load the old value. Growing the table publishes a new array and keeps the old
+// one alive until the table is destroyed, so a reader racing with a resize
+// still reads valid memory. Since the array doubles, retired arrays never
+// add up to more than the live one.
+//
+// Only names below kMaxDenseName are stored. lookup() returns false for
+// larger names, and the caller falls back to its locked sparse map.
+template <class T>
+class ReadMostlyNameTable {
+public:
+    static const uint32_t kMaxDenseName = 1 << 16;
+
+    ReadMostlyNameTable() : m_table(NULL) { }
+
+    ~ReadMostlyNameTable() {
+        delete m_table.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < m_retired.size(); ++i) {
+            delete m_retired[i];
+        }
+    }
+
+    // Lock-free. Returns false if |name| cannot be answered by the table.
+    bool lookup(uint32_t name, T** out) const {
+        if (name >= kMaxDenseName) return false;
+
+        const Table* table = m_table.load(std::memory_order_seq_cst);
+        if (!table || name >= table->size) {
+            *out = NULL;
+        } else {
+            *out = table->entries[name].load(std::memory_order_seq_cst);
+        }
+        return true;
+    }
+
+    // Writers only.
+    void set(uint32_t name, T* value) {
+        if (name >= kMaxDenseName) return;
+        growLocked(name + 1);
+        m_table.load(std::memory_order_relaxed)->entries[name].store(
+            value, std::memory_order_seq_cst);
+    }
+
+    void clear(uint32_t name) {
+        if (name >= kMaxDenseName) return;
+        Table* table = m_table.load(std::memory_order_relaxed);
+        if (!table || name >= table->size) return;
+        table->entries[name].store(NULL, std::memory_order_seq_cst);
+    }
+
+private:
+    struct Table {
+        explicit Table(uint32_t n) : size(n), entries(new std::atomic<T*>[n]) {
+            for (uint32_t i = 0; i < n; ++i) {
+                entries[i].store(NULL, std::memory_order_relaxed);
+            }
+        }
+        ~Table() { delete [] entries; }
+
+        uint32_t size;
+        std::atomic<T*>* entries;
+    };
+
+    void growLocked(uint32_t minSize) {
+        Table* table = m_table.load(std::memory_order_relaxed);
+        if (table && table->size >= minSize) return;
+
+        uint32_t newSize = table ? table->size : 64;
+        while (newSize < minSize) newSize <<= 1;
+
+        Table* newTable = new Table(newSize);
+        if (table) {
+            for (uint32_t i = 0; i < table->size; ++i) {
+                newTable->entries[i].store(
+                    table->entries[i].load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+            }
+            m_retired.push_back(table);
+        }
+        m_table.store(newTable, std::memory_order_seq_cst);
+    }
+
+    std::atomic<Table*> m_table;
+    std::vector<Table*> m_retired;
+};
@@ -18,11 +18,50 @@
 
 #include <GLES/gl.h>
 #include <map>
+#include <stdint.h>
+
+// Per-level sizes of a texture. Levels are bounded by log2 of the maximum
+// texture size, so they are kept in a flat array with a mask of the levels
+// that have been defined, rather than in a map.
+class TextureLevelSizes {
+public:
+    // Enough for 32768x32768.
+    static const GLsizei kMaxLevels = 16;
+
+    TextureLevelSizes() : m_definedLevels(0), m_outOfRange(0) {
+        for (GLsizei i = 0; i < kMaxLevels; ++i) m_sizes[i] = 0;
+    }
+
+    // Like std::map::operator[]: defines |level| with size 0 if needed.
+    GLsizei& operator[](GLsizei level) {
+        if (level < 0 || level >= kMaxLevels) {
+            m_outOfRange = 0;
+            return m_outOfRange;
+        }
+        m_definedLevels |= 1u << level;
+        return m_sizes[level];
+    }
+
+    // Lowest defined level, or 0 if none is.
+    GLsizei baseLevel() const {
+        for (GLsizei i = 0; i < kMaxLevels; ++i) {
+            if (m_definedLevels & (1u << i)) return i;
+        }
+        return 0;
+    }
+
+    GLsizei baseSize() const { return m_sizes[baseLevel()]; }
+
+private:
+    uint32_t m_definedLevels;
+    GLsizei m_sizes[kMaxLevels];
+    GLsizei m_outOfRange;
+};
 
 struct TextureDims {
-    std::map<GLsizei, GLsizei> widths;
-    std::map<GLsizei, GLsizei> heights;
-    std::map<GLsizei, GLsizei> depths;
+    TextureLevelSizes widths;
+    TextureLevelSizes heights;
+    TextureLevelSizes depths;
 };
 
 struct TextureRec {
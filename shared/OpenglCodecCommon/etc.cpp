@@ -233,6 +233,19 @@ void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
             baseX = 2;
         }
     }
+    // The 4 colors a pixel can take, so that the per-pixel work is a lookup.
+    etc1_byte colors[4][4];
+    for (int offset = 0; offset < 4; offset++) {
+        int delta = table[offset];
+        colors[offset][0] = clamp(r + delta);
+        colors[offset][1] = clamp(g + delta);
+        colors[offset][2] = clamp(b + delta);
+        colors[offset][3] = 255;
+    }
+    if (isPunchthroughAlpha && !opaque) {
+        // msb && !lsb: rgba all 0
+        memset(colors[2], 0, 4);
+    }
     for (int i = 0; i < 8; i++) {
         int x, y;
         if (flipped) {
@@ -243,22 +256,13 @@ void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
             y = baseY + (i & 3);
         }
         int k = y + (x * 4);
-        int msb = ((low >> (k + 15)) & 2);
-        int lsb = ((low >> k) & 1);
+        int offset = ((low >> (k + 15)) & 2) | ((low >> k) & 1);
         etc1_byte* q = pOut + channels * (x + 4 * y);
-        if (isPunchthroughAlpha && !opaque && msb && !lsb) {
-            // rgba all 0
-            memset(q, 0, 4);
-            q += 4;
-        } else {
-            int offset = lsb | msb;
-            int delta = table[offset];
-            *q++ = clamp(r + delta);
-            *q++ = clamp(g + delta);
-            *q++ = clamp(b + delta);
-            if (isPunchthroughAlpha) {
-                *q++ = 255;
-            }
+        q[0] = colors[offset][0];
+        q[1] = colors[offset][1];
+        q[2] = colors[offset][2];
+        if (isPunchthroughAlpha) {
+            q[3] = colors[offset][3];
         }
     }
 }
@@ -266,24 +270,27 @@ void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
 static void etc2_T_H_index(const int* clrTable, etc1_uint32 low,
                            bool isPunchthroughAlpha, bool opaque,
                            etc1_byte* pOut) {
+    etc1_byte colors[4][4];
+    for (int offset = 0; offset < 4; offset++) {
+        colors[offset][0] = clrTable[offset * 3];
+        colors[offset][1] = clrTable[offset * 3 + 1];
+        colors[offset][2] = clrTable[offset * 3 + 2];
+        colors[offset][3] = 255;
+    }
+    if (isPunchthroughAlpha && !opaque) {
+        // msb && !lsb: rgba all 0
+        memset(colors[2], 0, 4);
+    }
     etc1_byte* q = pOut;
     for (int y = 0; y < 4; y++) {
         for (int x = 0; x < 4; x++) {
             int k = y + x * 4;
-            int msb = (low >> (k + 15)) & 2;
-            int lsb = (low >> k) & 1;
-            if (isPunchthroughAlpha && !opaque && msb && !lsb) {
-                // rgba all 0
-                memset(q, 0, 4);
-                q += 4;
-            } else {
-                int offset = lsb | msb;
-                for (int c = 0; c < 3; c++) {
-                    *q++ = clrTable[offset*3 + c];
-                }
-                if (isPunchthroughAlpha) {
-                    *q++ = 255;
-                }
+            int offset = ((low >> (k + 15)) & 2) | ((low >> k) & 1);
+            *q++ = colors[offset][0];
+            *q++ = colors[offset][1];
+            *q++ = colors[offset][2];
+            if (isPunchthroughAlpha) {
+                *q++ = colors[offset][3];
             }
         }
     }
@@ -447,33 +454,16 @@ void eac_decode_single_channel_block(const etc1_byte* pIn,
     int multiplier = pIn[1] >> 4;
     int tblIdx = pIn[1] & 15;
     const int* table = kAlphaModifierTable + tblIdx * 8;
-    const etc1_byte* p = pIn + 2;
-    // position in a byte of the next 3-bit index:
-    // | a a a | b b b | c c c | d d d ...
-    // | byte               | byte...
-    int bitOffset = 5;
-    for (int i = 0; i < 16; i ++) {
-        // flip x, y in output
-        int outIdx = (i % 4) * 4 + i / 4;
-        etc1_byte* q = pOut + outIdx * decodedElementBytes;
 
-        int modifier = 0;
-        if (bitOffset < 0) { // (Part of) the index is in the next byte.
-            modifier += p[0] << (-bitOffset);
-            p ++;
-            bitOffset += 8;
-        }
-        modifier += p[0] >> bitOffset;
-        modifier &= 7;
-        bitOffset -= 3; // move to the next index
-        if (bitOffset == -3) {
-            bitOffset = 5;
-            p++;
-        }
+    // A pixel can only take one of 8 values; compute those once, then
+    // look them up by the 3-bit index of each pixel.
+    etc1_byte decodedBytes[8];
+    float decodedFloats[8];
+    for (int modifier = 0; modifier < 8; modifier++) {
         int modifierValue = table[modifier];
         int decoded = base_codeword + modifierValue * multiplier;
         if (decodedElementBytes == 1) {
-            *q = clamp(decoded);
+            decodedBytes[modifier] = clamp(decoded);
         } else { // decodedElementBytes == 4
             decoded *= 8;
             if (multiplier == 0) {
@@ -481,14 +471,31 @@ void eac_decode_single_channel_block(const etc1_byte* pIn,
             }
             if (isSigned) {
                 decoded = clampSigned1023(decoded);
-                reinterpret_cast<float*>(q)[0] = (float)decoded / 1023.0;
+                decodedFloats[modifier] = (float)decoded / 1023.0;
             } else {
                 decoded += 4;
                 decoded = clamp2047(decoded);
-                reinterpret_cast<float*>(q)[0] = (float)decoded / 2047.0;
+                decodedFloats[modifier] = (float)decoded / 2047.0;
             }
         }
     }
+
+    // 16 3-bit indices, most significant first:
+    // | a a a | b b b | c c c | d d d ...
+    uint64_t indices = 0;
+    for (int i = 2; i < 8; i++) {
+        indices = (indices << 8) | pIn[i];
+    }
+    for (int i = 0; i < 16; i ++) {
+        // flip x, y in output
+        int outIdx = (i % 4) * 4 + i / 4;
+        int modifier = (indices >> (45 - 3 * i)) & 7;
+        if (decodedElementBytes == 1) {
+            pOut[outIdx] = decodedBytes[modifier];
+        } else {
+            memcpy(pOut + outIdx * 4, &decodedFloats[modifier], 4);
+        }
+    }
 }
 
 typedef struct {
@@ -864,10 +871,12 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
 //        large enough to store entire image.
 
 
-int etc2_decode_image(const etc1_byte* pIn, ETC2ImageFormat format,
+// Decodes the block rows that cover pixel rows [yBegin, yEnd), yBegin a
+// multiple of 4.
+static void etc2_decode_block_rows(const etc1_byte* pIn, ETC2ImageFormat format,
         etc1_byte* pOut,
         etc1_uint32 width, etc1_uint32 height,
-        etc1_uint32 stride) {
+        etc1_uint32 stride, etc1_uint32 yBegin, etc1_uint32 yEnd) {
     etc1_byte block[std::max({ETC1_DECODED_BLOCK_SIZE,
                               ETC2_DECODED_RGB8A1_BLOCK_SIZE,
                               EAC_DECODED_R11_BLOCK_SIZE,
@@ -875,15 +884,15 @@ int etc2_decode_image(const etc1_byte* pIn, ETC2ImageFormat format,
     etc1_byte alphaBlock[EAC_DECODED_ALPHA_BLOCK_SIZE];
 
     etc1_uint32 encodedWidth = (width + 3) & ~3;
-    etc1_uint32 encodedHeight = (height + 3) & ~3;
 
     int pixelSize = etc_get_decoded_pixel_size(format);
     bool isSigned = (format == EtcSignedR11 || format == EtcSignedRG11);
 
-    for (etc1_uint32 y = 0; y < encodedHeight; y += 4) {
-        etc1_uint32 yEnd = height - y;
-        if (yEnd > 4) {
-            yEnd = 4;
+    pIn += etc_get_encoded_data_size(format, width, yBegin);
+    for (etc1_uint32 y = yBegin; y < yEnd; y += 4) {
+        etc1_uint32 rowEnd = std::min(height, yEnd) - y;
+        if (rowEnd > 4) {
+            rowEnd = 4;
         }
         for (etc1_uint32 x = 0; x < encodedWidth; x += 4) {
             etc1_uint32 xEnd = width - x;
@@ -923,7 +932,7 @@ int etc2_decode_image(const etc1_byte* pIn, ETC2ImageFormat format,
                 default:
                     assert(0);
             }
-            for (etc1_uint32 cy = 0; cy < yEnd; cy++) {
+            for (etc1_uint32 cy = 0; cy < rowEnd; cy++) {
                 etc1_byte* p = pOut + pixelSize * x + stride * (y + cy);
                 switch (format) {
                     case EtcRGB8:
@@ -967,6 +976,13 @@ int etc2_decode_image(const etc1_byte* pIn, ETC2ImageFormat format,
             }
         }
     }
+}
+
+int etc2_decode_image(const etc1_byte* pIn, ETC2ImageFormat format,
+        etc1_byte* pOut,
+        etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 stride) {
+    etc2_decode_block_rows(pIn, format, pOut, width, height, stride, 0, height);
     return 0;
 }
 
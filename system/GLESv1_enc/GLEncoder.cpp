@@ -17,6 +17,7 @@
 #include "glUtils.h"
 #include <log/log.h>
 #include <assert.h>
+#include <string.h>
 #include <vector>
 
 #ifndef MIN
@@ -356,9 +357,11 @@ void GLEncoder::s_glBindBuffer(void *self, GLenum target, GLuint id)
 {
     GLEncoder *ctx = (GLEncoder *) self;
     assert(ctx->m_state != NULL);
+    ctx->demotePromotedArrayBuffer(id);
     ctx->m_state->bindBuffer(target, id);
     // TODO set error state if needed;
     ctx->m_glBindBuffer_enc(self, target, id);
+    ctx->m_state->setLastEncodedBufferBind(target, id);
 }
 
 void GLEncoder::s_glBufferData(void * self, GLenum target, GLsizeiptr size, const GLvoid * data, GLenum usage)
@@ -389,14 +392,171 @@ void GLEncoder::s_glDeleteBuffers(void * self, GLsizei n, const GLuint * buffers
     GLEncoder *ctx = (GLEncoder *) self;
     SET_ERROR_IF(n<0, GL_INVALID_VALUE);
     for (int i=0; i<n; i++) {
+        ctx->demotePromotedArrayBuffer(buffers[i]);
         ctx->m_shared->deleteBufferData(buffers[i]);
+        ctx->m_state->unBindBuffer(buffers[i]);
         ctx->m_glDeleteBuffers_enc(self,1,&buffers[i]);
     }
 }
 
+// Client arrays drawn this many more times with the same range and contents
+// are moved to a hidden buffer object.
+static const uint32_t kPromoteAfterDraws = 3;
+// Smaller arrays are cheaper to send than to hash.
+static const GLsizei kMinPromotedArraySize = 256;
+
+// Only ever compared with earlier hashes of the same client array.
+static uint64_t hashClientArray(const void* data, size_t size)
+{
+    const unsigned char* ptr = (const unsigned char*)data;
+    uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+    while (size >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, ptr, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+        ptr += sizeof(word);
+        size -= sizeof(word);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, ptr, size);
+    hash = (hash ^ tail) * 0x100000001b3ULL;
+    return hash ^ (hash >> 32);
+}
+
+void GLEncoder::setClientState(GLClientState *state)
+{
+    // Promoted arrays are re-uploaded to the buffers of the new context.
+    if (state != m_state) resetPromotedArrays();
+    m_state = state;
+}
+
+void GLEncoder::resetPromotedArrays()
+{
+    memset(m_promotedArrays, 0, sizeof(m_promotedArrays));
+}
+
+// GLES1 lets the application bind names it never generated, so a name the
+// host handed out for a hidden buffer may still end up being used by the
+// application. If it does, the name is given up to the application and the
+// location gets a new hidden buffer next time.
+void GLEncoder::demotePromotedArrayBuffer(GLuint buffer)
+{
+    if (!buffer || !m_state) return;
+
+    for (int i = 0; i < GLClientState::LAST_LOCATION; i++) {
+        if (m_state->getPromotedArrayBuffer(i) != buffer) continue;
+        m_state->setPromotedArrayBuffer(i, 0);
+        memset(&m_promotedArrays[i], 0, sizeof(m_promotedArrays[i]));
+    }
+}
+
+void GLEncoder::deletePromotedArrayBuffers()
+{
+    if (!m_state) return;
+
+    for (int i = 0; i < GLClientState::LAST_LOCATION; i++) {
+        GLuint buffer = m_state->getPromotedArrayBuffer(i);
+        if (!buffer) continue;
+
+        m_glDeleteBuffers_enc(this, 1, &buffer);
+        // Deleting the bound buffer unbinds it on the host.
+        if (m_state->getLastEncodedBufferBind(GL_ARRAY_BUFFER) == buffer) {
+            m_state->setLastEncodedBufferBind(GL_ARRAY_BUFFER, 0);
+        }
+        m_state->setPromotedArrayBuffer(i, 0);
+    }
+    resetPromotedArrays();
+}
+
+GLEncoder::VertexDataStats GLEncoder::onFrameEnd()
+{
+    VertexDataStats stats = m_vertexDataStats;
+    memset(&m_vertexDataStats, 0, sizeof(m_vertexDataStats));
+    return stats;
+}
+
+void GLEncoder::bindBufferEncodeCached(GLenum target, GLuint id)
+{
+    if (id == m_state->getLastEncodedBufferBind(target)) {
+        ++m_vertexDataStats.bindsElided;
+        return;
+    }
+
+    m_glBindBuffer_enc(this, target, id);
+    m_state->setLastEncodedBufferBind(target, id);
+}
+
+void GLEncoder::clientActiveTextureEncodeCached(GLenum texture)
+{
+    if (texture == m_state->getLastEncodedClientActiveTexture()) {
+        ++m_vertexDataStats.clientActiveTexturesElided;
+        return;
+    }
+
+    m_glClientActiveTexture_enc(this, texture);
+    m_state->setLastEncodedClientActiveTexture(texture);
+}
+
+// Returns the hidden buffer that holds |size| bytes at |data| for |location|,
+// or 0 if the array is to be sent with the draw.
+GLuint GLEncoder::promoteClientArray(int location, const void* data, GLsizei size)
+{
+    if (!m_clientArrayPromotion || size < kMinPromotedArraySize) return 0;
+
+    PromotedArray& array = m_promotedArrays[location];
+
+    // Hashing starts once a range is drawn twice in a row, so arrays that
+    // move on every draw (sprite batches, for one) cost nothing extra.
+    if (array.data != data || array.size != size) {
+        array.data = data;
+        array.size = size;
+        array.hashValid = false;
+        array.stableDraws = 0;
+        array.uploaded = false;
+        return 0;
+    }
+
+    const uint64_t hash = hashClientArray(data, size);
+    if (!array.hashValid || hash != array.hash) {
+        array.hash = hash;
+        array.hashValid = true;
+        array.stableDraws = 0;
+        return 0;
+    }
+
+    if (array.stableDraws < kPromoteAfterDraws) {
+        ++array.stableDraws;
+        return 0;
+    }
+
+    GLuint buffer = m_state->getPromotedArrayBuffer(location);
+    if (!buffer) {
+        this->glGenBuffers(this, 1, &buffer);
+        if (!buffer) return 0;
+        // The application may have bound and filled this name without
+        // generating it; leave it alone and try another name next draw.
+        if (m_shared->getBufferData(buffer)) return 0;
+        m_state->setPromotedArrayBuffer(location, buffer);
+    }
+
+    if (!array.uploaded || array.uploadedHash != hash) {
+        bindBufferEncodeCached(GL_ARRAY_BUFFER, buffer);
+        m_glBufferData_enc(this, GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+        array.uploaded = true;
+        array.uploadedHash = hash;
+        ++m_vertexDataStats.promotedUploads;
+        m_vertexDataStats.promotedUploadBytes += size;
+    }
+
+    ++m_vertexDataStats.promotedArrayDraws;
+    return buffer;
+}
+
 void GLEncoder::sendVertexData(unsigned int first, unsigned int count)
 {
     assert(m_state != NULL);
+    ++m_vertexDataStats.draws;
     GLenum prevActiveTexUnit = m_state->getActiveTextureUnit();
     for (int i = 0; i < GLClientState::LAST_LOCATION; i++) {
         bool enableDirty;
@@ -407,7 +567,7 @@ void GLEncoder::sendVertexData(unsigned int first, unsigned int count)
 
         if ( i >= GLClientState::TEXCOORD0_LOCATION &&
             i <= GLClientState::TEXCOORD7_LOCATION ) {
-            m_glClientActiveTexture_enc(this, GL_TEXTURE0 + i - GLClientState::TEXCOORD0_LOCATION);
+            clientActiveTextureEncodeCached(GL_TEXTURE0 + i - GLClientState::TEXCOORD0_LOCATION);
         }
 
         if (state.enabled) {
@@ -419,8 +579,21 @@ void GLEncoder::sendVertexData(unsigned int first, unsigned int count)
             if (stride == 0) stride = state.elementSize;
             int firstIndex = stride * first;
 
-            this->m_glBindBuffer_enc(this, GL_ARRAY_BUFFER, state.bufferObject);
-            if (state.bufferObject == 0) {
+            GLuint bufferObject = state.bufferObject;
+            uintptr_t offset = (uintptr_t)state.data + firstIndex;
+            if (bufferObject == 0 && count > 0) {
+                // The hidden buffer holds the drawn range only, strided
+                // like the client array.
+                bufferObject = promoteClientArray(i,
+                        (unsigned char *)state.data + firstIndex,
+                        stride * (count - 1) + state.elementSize);
+                offset = 0;
+            }
+
+            bindBufferEncodeCached(GL_ARRAY_BUFFER, bufferObject);
+            if (bufferObject == 0) {
+                ++m_vertexDataStats.arraysSent;
+                m_vertexDataStats.bytesSent += datalen;
 
                 switch(i) {
                 case GLClientState::VERTEX_LOCATION:
@@ -467,19 +640,19 @@ void GLEncoder::sendVertexData(unsigned int first, unsigned int count)
                 switch(i) {
                 case GLClientState::VERTEX_LOCATION:
                     this->glVertexPointerOffset(this, state.size, state.type, state.stride,
-                                                (uintptr_t)state.data + firstIndex);
+                                                offset);
                     break;
                 case GLClientState::NORMAL_LOCATION:
                     this->glNormalPointerOffset(this, state.type, state.stride,
-                                                (uintptr_t)state.data + firstIndex);
+                                                offset);
                     break;
                 case GLClientState::POINTSIZE_LOCATION:
                     this->glPointSizePointerOffset(this, state.type, state.stride,
-                                                   (uintptr_t)state.data + firstIndex);
+                                                   offset);
                     break;
                 case GLClientState::COLOR_LOCATION:
                     this->glColorPointerOffset(this, state.size, state.type, state.stride,
-                                               (uintptr_t)state.data + firstIndex);
+                                               offset);
                     break;
                 case GLClientState::TEXCOORD0_LOCATION:
                 case GLClientState::TEXCOORD1_LOCATION:
@@ -490,23 +663,23 @@ void GLEncoder::sendVertexData(unsigned int first, unsigned int count)
                 case GLClientState::TEXCOORD6_LOCATION:
                 case GLClientState::TEXCOORD7_LOCATION:
                     this->glTexCoordPointerOffset(this, state.size, state.type, state.stride,
-                                                  (uintptr_t)state.data + firstIndex);
+                                                  offset);
                     break;
                 case GLClientState::WEIGHT_LOCATION:
                     this->glWeightPointerOffset(this,state.size,state.type,state.stride,
-                                                (uintptr_t)state.data+firstIndex);
+                                                offset);
                     break;
                 case GLClientState::MATRIXINDEX_LOCATION:
                     this->glMatrixIndexPointerOffset(this,state.size,state.type,state.stride,
-                                              (uintptr_t)state.data+firstIndex);
+                                              offset);
                     break;
                 }
             }
-            this->m_glBindBuffer_enc(this, GL_ARRAY_BUFFER, m_state->currentArrayVbo());
         } else {
             this->m_glDisableClientState_enc(this, state.glConst);
         }
     }
+    bindBufferEncodeCached(GL_ARRAY_BUFFER, m_state->currentArrayVbo());
     m_state->setActiveTextureUnit(prevActiveTexUnit);
 }
 
@@ -571,13 +744,13 @@ void GLEncoder::s_glDrawElements(void *self, GLenum mode, GLsizei count, GLenum
     if (ctx->m_state->currentIndexVbo() != 0) {
         if (!has_immediate_arrays) {
             ctx->sendVertexData(0, count);
-            ctx->m_glBindBuffer_enc(self, GL_ELEMENT_ARRAY_BUFFER, ctx->m_state->currentIndexVbo());
+            ctx->bindBufferEncodeCached(GL_ELEMENT_ARRAY_BUFFER, ctx->m_state->currentIndexVbo());
             ctx->glDrawElementsOffset(ctx, mode, count, type, (uintptr_t)indices);
             ctx->m_stream->flush();
             adjustIndices = false;
         } else {
             BufferData * buf = ctx->m_shared->getBufferData(ctx->m_state->currentIndexVbo());
-            ctx->m_glBindBuffer_enc(self, GL_ELEMENT_ARRAY_BUFFER, 0);
+            ctx->bindBufferEncodeCached(GL_ELEMENT_ARRAY_BUFFER, 0);
             indices = &buf->m_fixedBuffer[(GLintptr)indices];
         }
     }
@@ -1028,6 +1201,9 @@ GLEncoder::GLEncoder(IOStream *stream, ChecksumCalculator *protocol)
     m_error = GL_NO_ERROR;
     m_num_compressedTextureFormats = 0;
     m_compressedTextureFormats = NULL;
+    m_clientArrayPromotion = true;
+    resetPromotedArrays();
+    memset(&m_vertexDataStats, 0, sizeof(m_vertexDataStats));
 
     // overrides;
 #define OVERRIDE(name)  m_##name##_enc = this-> name ; this-> name = &s_##name
@@ -28,9 +28,7 @@ class GLEncoder : public gl_encoder_context_t {
 public:
     GLEncoder(IOStream *stream, ChecksumCalculator* protocol);
     virtual ~GLEncoder();
-    void setClientState(GLClientState *state) {
-        m_state = state;
-    }
+    void setClientState(GLClientState *state);
     void setSharedGroup(GLSharedGroupPtr shared) {
         m_shared = shared;
         if (m_state && m_shared)
@@ -48,6 +46,28 @@ public:
     void override2DTextureTarget(GLenum target);
     void restore2DTextureTarget();
 
+    // Lets client arrays that keep their pointer, range and contents across
+    // draws move into hidden host buffer objects.
+    void setClientArrayPromotion(bool enabled) { m_clientArrayPromotion = enabled; }
+    // Deletes the hidden buffer objects of the current client state. Called
+    // while its context is still current on the host, before it is switched
+    // out; they are re-created on demand.
+    void deletePromotedArrayBuffers();
+
+    // What sendVertexData() did during one frame.
+    struct VertexDataStats {
+        uint32_t draws;
+        uint32_t bindsElided;
+        uint32_t clientActiveTexturesElided;
+        uint32_t arraysSent;
+        uint32_t promotedArrayDraws;
+        uint32_t promotedUploads;
+        uint64_t bytesSent;
+        uint64_t promotedUploadBytes;
+    };
+    // Called at eglSwapBuffers. Returns the stats of the frame that ended.
+    VertexDataStats onFrameEnd();
+
 private:
 
     bool    m_initialized;
@@ -59,6 +79,29 @@ private:
     GLint m_num_compressedTextureFormats;
 
     GLint *getCompressedTextureFormats();
+
+    // One slot per client state location of the current context. A client
+    // array whose range and contents stay the same for kPromoteAfterDraws
+    // draws is uploaded to the location's hidden buffer object and drawn
+    // from there, until the range or the contents change.
+    struct PromotedArray {
+        const void* data;
+        GLsizei size;
+        uint64_t hash;
+        bool hashValid;
+        uint32_t stableDraws;
+        bool uploaded;
+        uint64_t uploadedHash;
+    };
+    bool m_clientArrayPromotion;
+    PromotedArray m_promotedArrays[GLClientState::LAST_LOCATION];
+    VertexDataStats m_vertexDataStats;
+    void resetPromotedArrays();
+    void demotePromotedArrayBuffer(GLuint buffer);
+    GLuint promoteClientArray(int location, const void* data, GLsizei size);
+    void bindBufferEncodeCached(GLenum target, GLuint id);
+    void clientActiveTextureEncodeCached(GLenum texture);
+
     // original functions;
     glGetError_client_proc_t    m_glGetError_enc;
     glGetIntegerv_client_proc_t m_glGetIntegerv_enc;
@@ -20,9 +20,12 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 #include <assert.h>
 #include <ctype.h>
+#include <math.h>
+#include <time.h>
 
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
@@ -77,6 +80,8 @@ GL2Encoder::GL2Encoder(IOStream *stream, ChecksumCalculator *protocol)
     m_hasSyncBufferData = false;
     m_initialized = false;
     m_noHostError = false;
+    m_guestOnlyErrors = false;
+    m_verifyGuestErrors = false;
     m_state = NULL;
     m_error = GL_NO_ERROR;
 
@@ -107,9 +112,19 @@ GL2Encoder::GL2Encoder(IOStream *stream, ChecksumCalculator *protocol)
 
     m_drawCallFlushInterval = 800;
     m_drawCallFlushCount = 0;
+    m_adaptiveDrawCallFlush = true;
+    m_drawCallFlushCost = 0;
+    m_lastDrawCallFlushNs = 0;
+    m_frameDrawCalls = 0;
+    memset(&m_drawCallFlushStats, 0, sizeof(m_drawCallFlushStats));
     m_primitiveRestartEnabled = false;
     m_primitiveRestartIndex = 0;
 
+    m_programBinaryCache = NULL;
+    m_numProgramBinaryFormats = -1;
+
+    m_shadowFreeBufferMinSize = 0;
+
     // overrides
 #define OVERRIDE(name)  m_##name##_enc = this-> name ; this-> name = &s_##name
 #define OVERRIDE_CUSTOM(name)  this-> name = &s_##name
@@ -410,6 +425,7 @@ GL2Encoder::GL2Encoder(IOStream *stream, ChecksumCalculator *protocol)
     OVERRIDE(glSamplerParameteriv);
 
     OVERRIDE(glGetAttribLocation);
+    OVERRIDE(glGetUniformBlockIndex);
 
     OVERRIDE(glBindAttribLocation);
     OVERRIDE(glUniformBlockBinding);
@@ -458,6 +474,13 @@ GL2Encoder::GL2Encoder(IOStream *stream, ChecksumCalculator *protocol)
 
     OVERRIDE(glStencilMask);
     OVERRIDE(glClearStencil);
+
+    OVERRIDE(glGenTextures);
+    OVERRIDE(glGenProgramPipelines);
+    OVERRIDE(glDeleteProgramPipelines);
+    OVERRIDE(glMemoryBarrier);
+    OVERRIDE(glMemoryBarrierByRegion);
+    OVERRIDE(glBindImageTexture);
 }
 
 GL2Encoder::~GL2Encoder()
@@ -465,23 +488,32 @@ GL2Encoder::~GL2Encoder()
     delete m_compressedTextureFormats;
 }
 
+// With guest-only errors, the error predicted by the validation in the
+// s_gl* overrides is all glGetError reports, and the host is not asked.
+// Otherwise a guest error takes precedence and the host is asked for
+// anything the guest could not detect. In verify mode the host is always
+// asked, and disagreements with the guest are logged; they point at
+// validation that is missing on the guest.
 GLenum GL2Encoder::s_glGetError(void * self)
 {
     GL2Encoder *ctx = (GL2Encoder *)self;
     GLenum err = ctx->getError();
-    if(err != GL_NO_ERROR) {
-        if (!ctx->m_noHostError) {
-            ctx->m_glGetError_enc(ctx); // also clear host error
-        }
-        ctx->setError(GL_NO_ERROR);
+    ctx->setError(GL_NO_ERROR);
+
+    if (ctx->m_noHostError ||
+        (ctx->m_guestOnlyErrors && !ctx->m_verifyGuestErrors)) {
         return err;
     }
 
-    if (ctx->m_noHostError) {
-        return GL_NO_ERROR;
-    } else {
-        return ctx->m_glGetError_enc(self);
+    GLenum hostErr = ctx->m_glGetError_enc(ctx); // also clears host error
+    if (ctx->m_verifyGuestErrors && hostErr != err) {
+        ALOGW("%s: guest error 0x%x, host error 0x%x\n", __FUNCTION__, err, hostErr);
+    }
+
+    if (err != GL_NO_ERROR || ctx->m_guestOnlyErrors) {
+        return err;
     }
+    return hostErr;
 }
 
 class GL2Encoder::ErrorUpdater {
@@ -489,8 +521,17 @@ public:
     ErrorUpdater(GL2Encoder* ctx) :
         mCtx(ctx),
         guest_error(ctx->getError()),
-        host_error(ctx->m_glGetError_enc(ctx)) {
-            if (ctx->m_noHostError) {
+        host_error(GL_NO_ERROR) {
+            // Clear the host error so that getHostErrorAndUpdate() sees
+            // only what the wrapped command raises. Without host errors
+            // there is nothing to clear.
+            if (!ctx->m_noHostError) {
+                host_error = ctx->m_glGetError_enc(ctx);
+            }
+            // With guest-only errors, glGetError does not clear the host
+            // error (outside verify mode), so what was pending here is
+            // stale.
+            if (ctx->m_guestOnlyErrors) {
                 host_error = GL_NO_ERROR;
             }
             // Preserve any existing GL error in the guest:
@@ -658,6 +699,32 @@ void GL2Encoder::doBindBufferEncodeCached(GLenum target, GLuint id) {
     m_state->setLastEncodedBufferBind(target, id);
 }
 
+bool GL2Encoder::canDropBufferShadow(GLenum target, GLuint bufferId, GLsizeiptr size) {
+    // Lazy fetches go through glMapBufferRangeAEMU, which needs ES3.
+    if (!m_shadowFreeBufferMinSize || majorVersion() < 3) return false;
+    if (size < m_shadowFreeBufferMinSize) return false;
+    if (target == GL_ELEMENT_ARRAY_BUFFER ||
+        bufferId == m_state->currentIndexVbo()) return false;
+
+    const BufferData* buf = m_shared->getBufferData(bufferId);
+    return !(buf && buf->m_needsShadow);
+}
+
+// Gives a shadow-free buffer its guest copy back, read from the host. The
+// buffer keeps its shadow from then on.
+void GL2Encoder::fetchBufferShadow(GLenum target, GLuint bufferId, BufferData* buf) {
+    m_shared->setBufferNeedsShadow(bufferId);
+    if (!buf->m_shadowFree) return;
+
+    m_shared->setBufferShadowFree(bufferId, false);
+    if (!buf->m_size) return;
+
+    doBindBufferEncodeCached(target, bufferId);
+    glMapBufferRangeAEMU(this, target, 0, buf->m_size, GL_MAP_READ_BIT,
+                         buf->m_fixedBuffer.data());
+    m_state->onHostMappedBuffer(target);
+}
+
 void GL2Encoder::s_glBufferData(void * self, GLenum target, GLsizeiptr size, const GLvoid * data, GLenum usage)
 {
     GL2Encoder *ctx = (GL2Encoder *) self;
@@ -667,7 +734,8 @@ void GL2Encoder::s_glBufferData(void * self, GLenum target, GLsizeiptr size, con
     SET_ERROR_IF(size<0, GL_INVALID_VALUE);
     SET_ERROR_IF(!GLESv2Validation::bufferUsage(ctx, usage), GL_INVALID_ENUM);
 
-    ctx->m_shared->updateBufferData(bufferId, size, data);
+    ctx->m_shared->updateBufferData(bufferId, size, data,
+                                    ctx->canDropBufferShadow(target, bufferId, size));
     ctx->m_shared->setBufferUsage(bufferId, usage);
     if (ctx->m_hasSyncBufferData) {
         ctx->glBufferDataSyncAEMU(self, target, size, data, usage);
@@ -754,6 +822,198 @@ void GL2Encoder::s_glVertexAttribPointer(void *self, GLuint indx, GLint size, GL
     }
 }
 
+// A value that cannot change for the lifetime of the host renderer, as
+// the host reported it.
+struct GL2ImmutableValue {
+    std::vector<GLint> ints;
+    std::vector<GLfloat> floats;
+};
+
+namespace {
+
+struct ImmutableParam {
+    GLenum param;
+    int majorVersion;
+    int minorVersion;
+    int count;
+    bool isFloat;
+};
+
+const ImmutableParam kImmutableParams[] = {
+    { GL_MAX_VERTEX_UNIFORM_VECTORS, 2, 0, 1, false },
+    { GL_MAX_FRAGMENT_UNIFORM_VECTORS, 2, 0, 1, false },
+    { GL_MAX_VARYING_VECTORS, 2, 0, 1, false },
+    { GL_MAX_VIEWPORT_DIMS, 2, 0, 2, false },
+    { GL_SUBPIXEL_BITS, 2, 0, 1, false },
+    { GL_NUM_COMPRESSED_TEXTURE_FORMATS, 2, 0, 1, false },
+    { GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, 2, 0, 1, false },
+    { GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, 2, 0, 1, false },
+    { GL_MAX_TEXTURE_IMAGE_UNITS, 2, 0, 1, false },
+    { GL_MAX_CUBE_MAP_TEXTURE_SIZE, 2, 0, 1, false },
+    { GL_MAX_RENDERBUFFER_SIZE, 2, 0, 1, false },
+    { GL_MAX_TEXTURE_SIZE, 2, 0, 1, false },
+    { GL_ALIASED_LINE_WIDTH_RANGE, 2, 0, 2, true },
+    { GL_ALIASED_POINT_SIZE_RANGE, 2, 0, 2, true },
+
+    { GL_MAX_3D_TEXTURE_SIZE, 3, 0, 1, false },
+    { GL_MAX_ARRAY_TEXTURE_LAYERS, 3, 0, 1, false },
+    { GL_MAX_ELEMENTS_INDICES, 3, 0, 1, false },
+    { GL_MAX_ELEMENTS_VERTICES, 3, 0, 1, false },
+    { GL_MAX_FRAGMENT_INPUT_COMPONENTS, 3, 0, 1, false },
+    { GL_MAX_FRAGMENT_UNIFORM_BLOCKS, 3, 0, 1, false },
+    { GL_MAX_FRAGMENT_UNIFORM_COMPONENTS, 3, 0, 1, false },
+    { GL_MAX_VERTEX_OUTPUT_COMPONENTS, 3, 0, 1, false },
+    { GL_MAX_VERTEX_UNIFORM_BLOCKS, 3, 0, 1, false },
+    { GL_MAX_VERTEX_UNIFORM_COMPONENTS, 3, 0, 1, false },
+    { GL_MAX_COMBINED_UNIFORM_BLOCKS, 3, 0, 1, false },
+    { GL_MAX_COMBINED_VERTEX_UNIFORM_COMPONENTS, 3, 0, 1, false },
+    { GL_MAX_COMBINED_FRAGMENT_UNIFORM_COMPONENTS, 3, 0, 1, false },
+    { GL_MAX_VARYING_COMPONENTS, 3, 0, 1, false },
+    { GL_MAX_PROGRAM_TEXEL_OFFSET, 3, 0, 1, false },
+    { GL_MIN_PROGRAM_TEXEL_OFFSET, 3, 0, 1, false },
+    { GL_MAX_TRANSFORM_FEEDBACK_INTERLEAVED_COMPONENTS, 3, 0, 1, false },
+    { GL_MAX_TRANSFORM_FEEDBACK_SEPARATE_COMPONENTS, 3, 0, 1, false },
+    { GL_MAX_TRANSFORM_FEEDBACK_SEPARATE_ATTRIBS, 3, 0, 1, false },
+    { GL_MAX_UNIFORM_BUFFER_BINDINGS, 3, 0, 1, false },
+    { GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, 3, 0, 1, false },
+    { GL_MAX_COLOR_ATTACHMENTS, 3, 0, 1, false },
+    { GL_MAX_DRAW_BUFFERS, 3, 0, 1, false },
+    { GL_MAX_TEXTURE_LOD_BIAS, 3, 0, 1, true },
+
+    { GL_MAX_ATOMIC_COUNTER_BUFFER_BINDINGS, 3, 1, 1, false },
+    { GL_MAX_ATOMIC_COUNTER_BUFFER_SIZE, 3, 1, 1, false },
+    { GL_MAX_COMBINED_ATOMIC_COUNTERS, 3, 1, 1, false },
+    { GL_MAX_COMBINED_IMAGE_UNIFORMS, 3, 1, 1, false },
+    { GL_MAX_COMBINED_SHADER_STORAGE_BLOCKS, 3, 1, 1, false },
+    { GL_MAX_COMPUTE_ATOMIC_COUNTERS, 3, 1, 1, false },
+    { GL_MAX_COMPUTE_IMAGE_UNIFORMS, 3, 1, 1, false },
+    { GL_MAX_COMPUTE_SHADER_STORAGE_BLOCKS, 3, 1, 1, false },
+    { GL_MAX_COMPUTE_SHARED_MEMORY_SIZE, 3, 1, 1, false },
+    { GL_MAX_COMPUTE_TEXTURE_IMAGE_UNITS, 3, 1, 1, false },
+    { GL_MAX_COMPUTE_UNIFORM_BLOCKS, 3, 1, 1, false },
+    { GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, 3, 1, 1, false },
+    { GL_MAX_FRAGMENT_ATOMIC_COUNTERS, 3, 1, 1, false },
+    { GL_MAX_FRAGMENT_IMAGE_UNIFORMS, 3, 1, 1, false },
+    { GL_MAX_FRAGMENT_SHADER_STORAGE_BLOCKS, 3, 1, 1, false },
+    { GL_MAX_FRAMEBUFFER_WIDTH, 3, 1, 1, false },
+    { GL_MAX_FRAMEBUFFER_HEIGHT, 3, 1, 1, false },
+    { GL_MAX_FRAMEBUFFER_SAMPLES, 3, 1, 1, false },
+    { GL_MAX_IMAGE_UNITS, 3, 1, 1, false },
+    { GL_MAX_PROGRAM_TEXTURE_GATHER_OFFSET, 3, 1, 1, false },
+    { GL_MIN_PROGRAM_TEXTURE_GATHER_OFFSET, 3, 1, 1, false },
+    { GL_MAX_SAMPLE_MASK_WORDS, 3, 1, 1, false },
+    { GL_MAX_SHADER_STORAGE_BLOCK_SIZE, 3, 1, 1, false },
+    { GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS, 3, 1, 1, false },
+    { GL_MAX_UNIFORM_LOCATIONS, 3, 1, 1, false },
+    { GL_MAX_VERTEX_ATOMIC_COUNTERS, 3, 1, 1, false },
+    { GL_MAX_VERTEX_ATTRIB_BINDINGS, 3, 1, 1, false },
+    { GL_MAX_VERTEX_ATTRIB_RELATIVE_OFFSET, 3, 1, 1, false },
+    { GL_MAX_VERTEX_ATTRIB_STRIDE, 3, 1, 1, false },
+    { GL_MAX_VERTEX_IMAGE_UNIFORMS, 3, 1, 1, false },
+    { GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, 3, 1, 1, false },
+    { GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, 3, 1, 1, false },
+};
+
+// Values fetched so far, shared by all encoders of the process. Each is
+// fetched by the first query for it; entries are never changed or removed
+// once added, so they can be read without the lock.
+struct GL2ImmutableState {
+    GL2ImmutableState() : compressedTextureFormatsFetched(false) {
+        memset(shaderPrecisionFormatsFetched, 0, sizeof(shaderPrecisionFormatsFetched));
+    }
+
+    std::map<GLenum, GL2ImmutableValue> values;
+
+    // range[0], range[1], precision for each shader type and precision type.
+    bool shaderPrecisionFormatsFetched[2][6];
+    GLint shaderPrecisionFormats[2][6][3];
+
+    bool compressedTextureFormatsFetched;
+    std::vector<GLint> compressedTextureFormats;
+};
+
+android::Mutex sImmutableStateLock;
+GL2ImmutableState sImmutableState;
+
+} // namespace
+
+const GL2ImmutableValue* GL2Encoder::getImmutableValue(GLenum param) {
+    const ImmutableParam* p = NULL;
+    for (size_t i = 0; i < sizeof(kImmutableParams) / sizeof(kImmutableParams[0]); ++i) {
+        if (kImmutableParams[i].param == param) {
+            p = &kImmutableParams[i];
+            break;
+        }
+    }
+    if (!p ||
+        m_currMajorVersion < p->majorVersion ||
+        (m_currMajorVersion == p->majorVersion &&
+         m_currMinorVersion < p->minorVersion)) {
+        return NULL;
+    }
+
+    {
+        android::AutoMutex _lock(sImmutableStateLock);
+        std::map<GLenum, GL2ImmutableValue>::const_iterator it =
+            sImmutableState.values.find(param);
+        if (it != sImmutableState.values.end()) return &it->second;
+    }
+
+    // First query in the process. Not done under the lock, so that other
+    // threads are not held up by this round trip.
+    GL2ImmutableValue value;
+    GLenum savedError = getError();
+    setError(GL_NO_ERROR);
+    if (p->isFloat) {
+        value.floats.resize(p->count);
+        safe_glGetFloatv(param, value.floats.data());
+    } else {
+        value.ints.resize(p->count);
+        safe_glGetIntegerv(param, value.ints.data());
+    }
+    GLenum error = getError();
+    setError(savedError);
+    // Unsupported by this host; leave it to the host every time.
+    if (error != GL_NO_ERROR) return NULL;
+
+    android::AutoMutex _lock(sImmutableStateLock);
+    return &sImmutableState.values.insert(std::make_pair(param, value)).first->second;
+}
+
+bool GL2Encoder::getImmutableIntegerv(GLenum param, GLint *val) {
+    const GL2ImmutableValue* value = getImmutableValue(param);
+    if (!value) return false;
+
+    if (value->ints.empty()) {
+        for (size_t i = 0; i < value->floats.size(); ++i) {
+            val[i] = (GLint)lroundf(value->floats[i]);
+        }
+    } else {
+        memcpy(val, value->ints.data(), value->ints.size() * sizeof(GLint));
+    }
+    return true;
+}
+
+bool GL2Encoder::getImmutableFloatv(GLenum param, GLfloat *val) {
+    const GL2ImmutableValue* value = getImmutableValue(param);
+    if (!value) return false;
+
+    if (value->floats.empty()) {
+        for (size_t i = 0; i < value->ints.size(); ++i) {
+            val[i] = (GLfloat)value->ints[i];
+        }
+    } else {
+        memcpy(val, value->floats.data(), value->floats.size() * sizeof(GLfloat));
+    }
+    return true;
+}
+
+void GL2Encoder::immutable_glGetIntegerv(GLenum param, GLint *val) {
+    if (!getImmutableIntegerv(param, val)) {
+        safe_glGetIntegerv(param, val);
+    }
+}
+
 void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
 {
     GL2Encoder *ctx = (GL2Encoder *) self;
@@ -790,7 +1050,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_combinedTextureImageUnits != 0) {
             *ptr = ctx->m_max_combinedTextureImageUnits;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_combinedTextureImageUnits = *ptr;
         }
         break;
@@ -798,7 +1058,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_vertexTextureImageUnits != 0) {
             *ptr = ctx->m_max_vertexTextureImageUnits;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_vertexTextureImageUnits = *ptr;
         }
         break;
@@ -806,7 +1066,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_array_texture_layers != 0) {
             *ptr = ctx->m_max_array_texture_layers;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_array_texture_layers = *ptr;
         }
         break;
@@ -814,7 +1074,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_textureImageUnits != 0) {
             *ptr = ctx->m_max_textureImageUnits;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_textureImageUnits = *ptr;
         }
         break;
@@ -834,7 +1094,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_vertexAttribStride != 0) {
             *ptr = ctx->m_max_vertexAttribStride;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_vertexAttribStride = *ptr;
         }
         break;
@@ -842,7 +1102,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_cubeMapTextureSize != 0) {
             *ptr = ctx->m_max_cubeMapTextureSize;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_cubeMapTextureSize = *ptr;
         }
         break;
@@ -850,7 +1110,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_renderBufferSize != 0) {
             *ptr = ctx->m_max_renderBufferSize;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_renderBufferSize = *ptr;
         }
         break;
@@ -858,7 +1118,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_textureSize != 0) {
             *ptr = ctx->m_max_textureSize;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_textureSize = *ptr;
             if (ctx->m_max_textureSize > 0) {
                 uint32_t current = 1;
@@ -873,7 +1133,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_3d_textureSize != 0) {
             *ptr = ctx->m_max_3d_textureSize;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_3d_textureSize = *ptr;
         }
         break;
@@ -881,7 +1141,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_ssbo_offset_align != 0) {
             *ptr = ctx->m_ssbo_offset_align;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_ssbo_offset_align = *ptr;
         }
         break;
@@ -889,7 +1149,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_ubo_offset_align != 0) {
             *ptr = ctx->m_ubo_offset_align;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_ubo_offset_align = *ptr;
         }
         break;
@@ -908,7 +1168,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_transformFeedbackSeparateAttribs != 0) {
             *ptr = ctx->m_max_transformFeedbackSeparateAttribs;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_transformFeedbackSeparateAttribs = *ptr;
         }
         break;
@@ -917,7 +1177,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_uniformBufferBindings != 0) {
             *ptr = ctx->m_max_uniformBufferBindings;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_uniformBufferBindings = *ptr;
         }
         break;
@@ -927,7 +1187,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_colorAttachments != 0) {
             *ptr = ctx->m_max_colorAttachments;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_colorAttachments = *ptr;
         }
         break;
@@ -937,7 +1197,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_drawBuffers != 0) {
             *ptr = ctx->m_max_drawBuffers;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_drawBuffers = *ptr;
         }
         break;
@@ -949,7 +1209,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_atomicCounterBufferBindings != 0) {
             *ptr = ctx->m_max_atomicCounterBufferBindings;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_atomicCounterBufferBindings = *ptr;
         }
         break;
@@ -960,7 +1220,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_shaderStorageBufferBindings != 0) {
             *ptr = ctx->m_max_shaderStorageBufferBindings;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_shaderStorageBufferBindings = *ptr;
         }
         break;
@@ -971,7 +1231,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
         if (ctx->m_max_vertexAttribBindings != 0) {
             *ptr = ctx->m_max_vertexAttribBindings;
         } else {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
             ctx->m_max_vertexAttribBindings = *ptr;
         }
         break;
@@ -982,7 +1242,7 @@ void GL2Encoder::s_glGetIntegerv(void *self, GLenum param, GLint *ptr)
     default:
         if (!state) return;
         if (!state->getClientStateParameter<GLint>(param, ptr)) {
-            ctx->safe_glGetIntegerv(param, ptr);
+            ctx->immutable_glGetIntegerv(param, ptr);
         }
         break;
     }
@@ -1045,7 +1305,8 @@ void GL2Encoder::s_glGetFloatv(void *self, GLenum param, GLfloat *ptr)
 
     default:
         if (!state) return;
-        if (!state->getClientStateParameter<GLfloat>(param, ptr)) {
+        if (!state->getClientStateParameter<GLfloat>(param, ptr) &&
+            !ctx->getImmutableFloatv(param, ptr)) {
             ctx->safe_glGetFloatv(param, ptr);
         }
         break;
@@ -1395,11 +1656,61 @@ void GL2Encoder::sendVertexAttributes(GLint first, GLsizei count, bool hasClient
     }
 }
 
-void GL2Encoder::flushDrawCall() {
-    if (m_drawCallFlushCount % m_drawCallFlushInterval == 0) {
-        m_stream->flush();
+// Flushes after draws 1, 2, 4 and 8 of a frame, so the host starts
+// rendering while the rest of the frame is encoded.
+static const uint32_t kFrameStartFlushDraws = 8;
+// Commands the host has not seen yet.
+static const size_t kDrawCallFlushPendingBytes = 256 * 1024;
+// Vertices drawn since the last flush.
+static const uint64_t kDrawCallFlushCost = 256 * 1024;
+// Time since the last flush, after which the host is likely idle.
+static const uint64_t kDrawCallFlushDelayNs = 2000000;
+
+static uint64_t monotonicTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void GL2Encoder::flushDrawCall(GLsizei count, GLsizei primcount) {
+    ++m_drawCallFlushCount;
+    ++m_frameDrawCalls;
+    ++m_drawCallFlushStats.draws;
+    m_drawCallFlushCost += (uint64_t)count * (primcount > 1 ? primcount : 1);
+
+    uint32_t* reason = NULL;
+    uint64_t now = 0;
+    if (m_adaptiveDrawCallFlush) {
+        now = monotonicTimeNs();
+        if (m_frameDrawCalls <= kFrameStartFlushDraws &&
+            !(m_frameDrawCalls & (m_frameDrawCalls - 1))) {
+            reason = &m_drawCallFlushStats.frameStartFlushes;
+        } else if (m_stream->pendingSize() >= kDrawCallFlushPendingBytes) {
+            reason = &m_drawCallFlushStats.pendingBytesFlushes;
+        } else if (m_drawCallFlushCost >= kDrawCallFlushCost) {
+            reason = &m_drawCallFlushStats.drawCostFlushes;
+        } else if (now - m_lastDrawCallFlushNs >= kDrawCallFlushDelayNs) {
+            reason = &m_drawCallFlushStats.delayFlushes;
+        }
+    }
+    if (!reason && m_drawCallFlushCount >= m_drawCallFlushInterval) {
+        reason = &m_drawCallFlushStats.intervalFlushes;
     }
-    m_drawCallFlushCount++;
+    if (!reason) return;
+
+    m_stream->flush();
+    ++*reason;
+    ++m_drawCallFlushStats.flushes;
+    m_drawCallFlushCount = 0;
+    m_drawCallFlushCost = 0;
+    m_lastDrawCallFlushNs = now;
+}
+
+GL2Encoder::DrawCallFlushStats GL2Encoder::onFrameEnd() {
+    DrawCallFlushStats stats = m_drawCallFlushStats;
+    memset(&m_drawCallFlushStats, 0, sizeof(m_drawCallFlushStats));
+    m_frameDrawCalls = 0;
+    return stats;
 }
 
 static bool isValidDrawMode(GLenum mode)
@@ -1440,6 +1751,7 @@ void GL2Encoder::s_glDrawArrays(void *self, GLenum mode, GLint first, GLsizei co
         ctx->m_glDrawArrays_enc(ctx, mode, first, count);
     }
 
+    ctx->flushDrawCall(count);
     ctx->m_state->postDraw();
 }
 
@@ -1478,6 +1790,7 @@ void GL2Encoder::s_glDrawElements(void *self, GLenum mode, GLsizei count, GLenum
     // caching previous results.
     if (ctx->m_state->currentIndexVbo() != 0) {
         buf = ctx->m_shared->getBufferData(ctx->m_state->currentIndexVbo());
+        ctx->fetchBufferShadow(GL_ELEMENT_ARRAY_BUFFER, ctx->m_state->currentIndexVbo(), buf);
         offset = (GLintptr)indices;
         indices = &buf->m_fixedBuffer[offset];
         ctx->getBufferIndexRange(buf,
@@ -1505,7 +1818,6 @@ void GL2Encoder::s_glDrawElements(void *self, GLenum mode, GLsizei count, GLenum
         if (!has_client_vertex_arrays) {
             ctx->doBindBufferEncodeCached(GL_ELEMENT_ARRAY_BUFFER, ctx->m_state->currentIndexVbo());
             ctx->glDrawElementsOffset(ctx, mode, count, type, offset);
-            ctx->flushDrawCall();
             adjustIndices = false;
         } else {
             ctx->doBindBufferEncodeCached(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -1533,6 +1845,7 @@ void GL2Encoder::s_glDrawElements(void *self, GLenum mode, GLsizei count, GLenum
         }
     }
 
+    ctx->flushDrawCall(count);
     ctx->m_state->postDraw();
 }
 
@@ -1557,7 +1870,7 @@ void GL2Encoder::s_glDrawArraysNullAEMU(void *self, GLenum mode, GLint first, GL
     } else {
         ctx->m_glDrawArraysNullAEMU_enc(ctx, mode, first, count);
     }
-    ctx->flushDrawCall();
+    ctx->flushDrawCall(count);
     ctx->m_state->postDraw();
 }
 
@@ -1598,6 +1911,7 @@ void GL2Encoder::s_glDrawElementsNullAEMU(void *self, GLenum mode, GLsizei count
             // Don't do anything
         } else {
             buf = ctx->m_shared->getBufferData(ctx->m_state->currentIndexVbo());
+            ctx->fetchBufferShadow(GL_ELEMENT_ARRAY_BUFFER, ctx->m_state->currentIndexVbo(), buf);
             offset = (GLintptr)indices;
             indices = &buf->m_fixedBuffer[offset];
             ctx->getBufferIndexRange(buf,
@@ -1626,7 +1940,6 @@ void GL2Encoder::s_glDrawElementsNullAEMU(void *self, GLenum mode, GLsizei count
         if (!has_client_vertex_arrays) {
             ctx->doBindBufferEncodeCached(GL_ELEMENT_ARRAY_BUFFER, ctx->m_state->currentIndexVbo());
             ctx->glDrawElementsOffsetNullAEMU(ctx, mode, count, type, offset);
-            ctx->flushDrawCall();
             adjustIndices = false;
         } else {
             ctx->m_glBindBuffer_enc(self, GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -1653,6 +1966,7 @@ void GL2Encoder::s_glDrawElementsNullAEMU(void *self, GLenum mode, GLsizei count
             ALOGE("glDrawElementsNullAEMU: direct index & direct buffer data - will be implemented in later versions;\n");
         }
     }
+    ctx->flushDrawCall(count);
     ctx->m_state->postDraw();
 }
 
@@ -1664,7 +1978,31 @@ GLint * GL2Encoder::getCompressedTextureFormats()
         if (m_num_compressedTextureFormats > 0) {
             // get number of texture formats;
             m_compressedTextureFormats = new GLint[m_num_compressedTextureFormats];
-            this->glGetCompressedTextureFormats(this, m_num_compressedTextureFormats, m_compressedTextureFormats);
+            size_t bytes = m_num_compressedTextureFormats * sizeof(GLint);
+            bool cached = false;
+            {
+                android::AutoMutex _lock(sImmutableStateLock);
+                if (sImmutableState.compressedTextureFormatsFetched &&
+                    sImmutableState.compressedTextureFormats.size() ==
+                        (size_t)m_num_compressedTextureFormats) {
+                    memcpy(m_compressedTextureFormats,
+                           sImmutableState.compressedTextureFormats.data(), bytes);
+                    cached = true;
+                }
+            }
+            if (!cached) {
+                // Not under the lock, so that other threads are not held
+                // up by this round trip.
+                this->glGetCompressedTextureFormats(this, m_num_compressedTextureFormats, m_compressedTextureFormats);
+
+                android::AutoMutex _lock(sImmutableStateLock);
+                if (!sImmutableState.compressedTextureFormatsFetched) {
+                    sImmutableState.compressedTextureFormats.assign(
+                        m_compressedTextureFormats,
+                        m_compressedTextureFormats + m_num_compressedTextureFormats);
+                    sImmutableState.compressedTextureFormatsFetched = true;
+                }
+            }
         }
     }
     return m_compressedTextureFormats;
@@ -1862,6 +2200,9 @@ void GL2Encoder::s_glShaderSource(void *self, GLuint shader, GLsizei count, cons
     SET_ERROR_IF(!shaderData, GL_INVALID_OPERATION);
     SET_ERROR_IF((count<0), GL_INVALID_VALUE);
 
+    // A deferred compile refers to the previous sources.
+    ctx->flushPendingShaderCompile(shader);
+
     // Track original sources---they may be translated in the backend
     std::vector<std::string> orig_sources;
     if (length) {
@@ -1918,12 +2259,30 @@ void GL2Encoder::s_glLinkProgram(void * self, GLuint program)
         SET_ERROR_IF(ctx->m_state->getTransformFeedbackActive(), GL_INVALID_OPERATION);
     }
 
-    ctx->m_glLinkProgram_enc(self, program);
+    uint64_t cacheKey = 0;
+    bool useCache = ctx->programBinaryCacheEnabled() &&
+                    ctx->m_shared->getProgramLinkKey(program, &cacheKey);
 
     GLint linkStatus = 0;
-    ctx->m_glGetProgramiv_enc(self, program, GL_LINK_STATUS, &linkStatus);
+    if (useCache && ctx->linkProgramFromCache(program, cacheKey)) {
+        linkStatus = GL_TRUE;
+    } else {
+        std::vector<GLuint> pendingCompiles =
+            ctx->m_shared->takePendingShaderCompiles(program);
+        for (size_t i = 0; i < pendingCompiles.size(); ++i) {
+            ctx->m_glCompileShader_enc(self, pendingCompiles[i]);
+        }
+
+        ctx->m_glLinkProgram_enc(self, program);
+        ctx->m_glGetProgramiv_enc(self, program, GL_LINK_STATUS, &linkStatus);
+
+        if (useCache && linkStatus) {
+            ctx->storeProgramBinary(program, cacheKey);
+        }
+    }
     ctx->m_shared->setProgramLinkStatus(program, linkStatus);
     if (!linkStatus) {
+        ctx->m_shared->clearProgramCachedLocations(program);
         return;
     }
 
@@ -1972,6 +2331,58 @@ void GL2Encoder::s_glLinkProgram(void * self, GLuint program)
     delete[] name;
 }
 
+bool GL2Encoder::programBinaryCacheEnabled() {
+    if (!m_programBinaryCache || majorVersion() < 3) return false;
+
+    if (m_numProgramBinaryFormats < 0) {
+        m_numProgramBinaryFormats = 0;
+        m_glGetIntegerv_enc(this, GL_NUM_PROGRAM_BINARY_FORMATS, &m_numProgramBinaryFormats);
+    }
+
+    return m_numProgramBinaryFormats > 0;
+}
+
+bool GL2Encoder::linkProgramFromCache(GLuint program, uint64_t key) {
+    GLenum format;
+    std::vector<char> binary;
+    if (!m_programBinaryCache->lookup(key, &format, &binary)) return false;
+
+    m_glProgramBinary_enc(this, program, format, binary.data(), binary.size());
+
+    GLint linkStatus = 0;
+    m_glGetProgramiv_enc(this, program, GL_LINK_STATUS, &linkStatus);
+    if (!linkStatus) {
+        // The host rejected the binary (e.g. driver update without a
+        // renderer string change); drop it and link normally.
+        m_programBinaryCache->evict(key);
+        return false;
+    }
+
+    return true;
+}
+
+void GL2Encoder::storeProgramBinary(GLuint program, uint64_t key) {
+    GLint length = 0;
+    m_glGetProgramiv_enc(this, program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0 || (size_t)length > ProgramBinaryCache::kMaxEntrySize) return;
+
+    std::vector<char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    m_glGetProgramBinary_enc(this, program, length, &written, &format, binary.data());
+    if (written <= 0 || written > length) return;
+
+    m_programBinaryCache->insert(key, format, binary.data(), written);
+}
+
+void GL2Encoder::flushPendingShaderCompile(GLuint shader) {
+    ShaderData* shaderData = m_shared->getShaderData(shader);
+    if (!shaderData || !shaderData->compilePending) return;
+
+    shaderData->compilePending = false;
+    m_glCompileShader_enc(this, shader);
+}
+
 #define VALIDATE_PROGRAM_NAME(program) \
     bool isShaderOrProgramObject = \
         ctx->m_shared->isShaderOrProgramObject(program); \
@@ -2092,6 +2503,7 @@ void GL2Encoder::s_glGetShaderInfoLog(void *self, GLuint shader, GLsizei bufsize
     GL2Encoder *ctx = (GL2Encoder*)self;
     VALIDATE_SHADER_NAME(shader);
     SET_ERROR_IF(bufsize < 0, GL_INVALID_VALUE);
+    ctx->flushPendingShaderCompile(shader);
     ctx->m_glGetShaderInfoLog_enc(self, shader, bufsize, length, infolog);
 }
 
@@ -2182,7 +2594,18 @@ int GL2Encoder::s_glGetUniformLocation(void *self, GLuint program, const GLchar
     RET_AND_SET_ERROR_IF(!isProgram, GL_INVALID_OPERATION, -1);
     RET_AND_SET_ERROR_IF(!ctx->m_shared->getProgramLinkStatus(program), GL_INVALID_OPERATION, -1);
 
-    return ctx->m_glGetUniformLocation_enc(self, program, name);
+    if (!name) return ctx->m_glGetUniformLocation_enc(self, program, name);
+
+    GLint location;
+    if (ctx->m_shared->getProgramCachedLocation(
+            program, ProgramData::LOCATION_UNIFORM, name, &location)) {
+        return location;
+    }
+
+    location = ctx->m_glGetUniformLocation_enc(self, program, name);
+    ctx->m_shared->setProgramCachedLocation(
+        program, ProgramData::LOCATION_UNIFORM, name, location);
+    return location;
 }
 
 bool GL2Encoder::updateHostTexture2DBinding(GLenum texUnit, GLenum newTarget)
@@ -2462,6 +2885,8 @@ void GL2Encoder::s_glDeleteTextures(void* self, GLsizei n, const GLuint* texture
     GL2Encoder* ctx = (GL2Encoder*)self;
     GLClientState* state = ctx->m_state;
 
+    SET_ERROR_IF(n < 0, GL_INVALID_VALUE);
+
     state->deleteTextures(n, textures);
     ctx->m_glDeleteTextures_enc(ctx, n, textures);
 }
@@ -2599,6 +3024,77 @@ static int ilog2(uint32_t x) {
     return p;
 }
 
+// Each texture upload command carries its pixels inline, and the host only
+// starts on a command once all of it has arrived. Splitting large uploads
+// lets the host work on the first bands while the rest is still being
+// copied into the stream.
+static const size_t kTextureUploadChunkSize = 1024 * 1024;
+static const size_t kMinChunkedTextureUploadSize = 4 * kTextureUploadChunkSize;
+
+bool GL2Encoder::texSubImage2DChunked(GLenum target, GLint level,
+                                      GLint xoffset, GLint yoffset,
+                                      GLsizei width, GLsizei height,
+                                      GLenum format, GLenum type, const GLvoid* pixels) {
+    if (!pixels || !width || !height) return false;
+    if (m_state->pixelDataSize(width, height, 1, format, type, 0) <
+        kMinChunkedTextureUploadSize) {
+        return false;
+    }
+
+    int bpp, startOffset, pixelRowSize, totalRowSize, skipRows;
+    m_state->getUnpackingOffsets2D(width, height, format, type,
+                                   &bpp, &startOffset, &pixelRowSize,
+                                   &totalRowSize, &skipRows);
+    if (totalRowSize <= 0) return false;
+
+    // The unpack skips apply relative to the pointer of each band, so
+    // moving the pointer on by whole rows keeps them valid.
+    GLsizei bandRows = std::max<GLsizei>(1, kTextureUploadChunkSize / totalRowSize);
+    for (GLsizei row = 0; row < height; row += bandRows) {
+        GLsizei rows = std::min(bandRows, height - row);
+        m_glTexSubImage2D_enc(this, target, level, xoffset, yoffset + row,
+                              width, rows, format, type,
+                              (const char*)pixels + (size_t)row * totalRowSize);
+    }
+    return true;
+}
+
+bool GL2Encoder::texSubImage3DChunked(GLenum target, GLint level,
+                                      GLint xoffset, GLint yoffset, GLint zoffset,
+                                      GLsizei width, GLsizei height, GLsizei depth,
+                                      GLenum format, GLenum type, const GLvoid* pixels) {
+    if (!pixels || !width || !height || !depth) return false;
+    if (m_state->pixelDataSize(width, height, depth, format, type, 0) <
+        kMinChunkedTextureUploadSize) {
+        return false;
+    }
+
+    int bpp, startOffset, pixelRowSize, totalRowSize;
+    int pixelImageSize, totalImageSize, skipRows, skipImages;
+    m_state->getUnpackingOffsets3D(width, height, depth, format, type,
+                                   &bpp, &startOffset, &pixelRowSize,
+                                   &totalRowSize, &pixelImageSize,
+                                   &totalImageSize, &skipRows, &skipImages);
+    if (totalRowSize <= 0 || totalImageSize <= 0) return false;
+
+    // Bands of whole images, or of rows of one image if images are large.
+    GLsizei bandImages = std::max<GLsizei>(1, kTextureUploadChunkSize / totalImageSize);
+    GLsizei bandRows = (size_t)totalImageSize > kTextureUploadChunkSize ?
+        std::max<GLsizei>(1, kTextureUploadChunkSize / totalRowSize) : height;
+    for (GLsizei image = 0; image < depth; image += bandImages) {
+        GLsizei images = std::min(bandImages, depth - image);
+        const char* imagePixels = (const char*)pixels + (size_t)image * totalImageSize;
+        for (GLsizei row = 0; row < height; row += bandRows) {
+            GLsizei rows = std::min(bandRows, height - row);
+            m_glTexSubImage3D_enc(this, target, level,
+                                  xoffset, yoffset + row, zoffset + image,
+                                  width, rows, images, format, type,
+                                  imagePixels + (size_t)row * totalRowSize);
+        }
+    }
+    return true;
+}
+
 void GL2Encoder::s_glTexImage2D(void* self, GLenum target, GLint level,
         GLint internalformat, GLsizei width, GLsizei height, GLint border,
         GLenum format, GLenum type, const GLvoid* pixels)
@@ -2671,6 +3167,15 @@ void GL2Encoder::s_glTexImage2D(void* self, GLenum target, GLint level,
                 ctx, target, level, internalformat,
                 width, height, border,
                 format, type, (uintptr_t)pixels);
+    } else if (pixels &&
+               ctx->m_state->pixelDataSize(width, height, 1, format, type, 0) >=
+                   kMinChunkedTextureUploadSize) {
+        ctx->m_glTexImage2D_enc(
+                ctx, target, level, internalformat,
+                width, height, border,
+                format, type, NULL);
+        ctx->texSubImage2DChunked(target, level, 0, 0, width, height,
+                                  format, type, pixels);
     } else {
         ctx->m_glTexImage2D_enc(
                 ctx, target, level, internalformat,
@@ -2743,7 +3248,8 @@ void GL2Encoder::s_glTexSubImage2D(void* self, GLenum target, GLint level,
                 ctx, target, level,
                 xoffset, yoffset, width, height,
                 format, type, (uintptr_t)pixels);
-    } else {
+    } else if (!ctx->texSubImage2DChunked(target, level, xoffset, yoffset,
+                                          width, height, format, type, pixels)) {
         ctx->m_glTexSubImage2D_enc(ctx, target, level, xoffset, yoffset, width,
                 height, format, type, pixels);
     }
@@ -3169,26 +3675,66 @@ GLboolean GL2Encoder::s_glUnmapBufferOES(void* self, GLenum target) {
     return ctx->glUnmapBuffer(ctx, target);
 }
 
+// Write maps at least this large are diffed against a snapshot on unmap,
+// so that only the pages the app touched are sent to the host.
+static const GLsizeiptr kDirtyTrackPageSize = 4096;
+static const GLsizeiptr kMinDirtyTrackedMapLength = 16 * kDirtyTrackPageSize;
+
+static bool shouldTrackMapDirtyPages(GLbitfield access, GLsizeiptr length) {
+    return (access & GL_MAP_WRITE_BIT) &&
+           !(access & GL_MAP_FLUSH_EXPLICIT_BIT) &&
+           length >= kMinDirtyTrackedMapLength;
+}
+
+// Appends the page-aligned ranges (relative to the start of the map) where
+// |current| differs from |snapshot|, merging adjacent dirty pages.
+static void getDirtyMapRanges(const char* current, const char* snapshot, GLsizeiptr length,
+                              std::vector<std::pair<GLintptr, GLsizeiptr> >* ranges) {
+    for (GLintptr page = 0; page < length; page += kDirtyTrackPageSize) {
+        GLsizeiptr pageLength = MIN(kDirtyTrackPageSize, length - page);
+        if (!memcmp(current + page, snapshot + page, pageLength)) continue;
+
+        if (!ranges->empty() &&
+            ranges->back().first + ranges->back().second == page) {
+            ranges->back().second += pageLength;
+        } else {
+            ranges->push_back(std::make_pair(page, pageLength));
+        }
+    }
+}
+
 void* GL2Encoder::s_glMapBufferRangeAEMUImpl(GL2Encoder* ctx, GLenum target,
                                              GLintptr offset, GLsizeiptr length,
                                              GLbitfield access, BufferData* buf) {
     char* bits = &buf->m_fixedBuffer[offset];
+    bool fetched = false;
 
     if ((access & GL_MAP_READ_BIT) ||
         ((access & GL_MAP_WRITE_BIT) &&
         (!(access & GL_MAP_INVALIDATE_RANGE_BIT) &&
          !(access & GL_MAP_INVALIDATE_BUFFER_BIT)))) {
 
-        if (ctx->m_state->shouldSkipHostMapBuffer(target))
-            return bits;
+        if (!ctx->m_state->shouldSkipHostMapBuffer(target)) {
+            ctx->glMapBufferRangeAEMU(
+                    ctx, target,
+                    offset, length,
+                    access,
+                    bits);
 
-        ctx->glMapBufferRangeAEMU(
-                ctx, target,
-                offset, length,
-                access,
-                bits);
+            ctx->m_state->onHostMappedBuffer(target);
+            fetched = true;
+        }
+    }
 
-        ctx->m_state->onHostMappedBuffer(target);
+    // Unchanged pages are only safe to skip if the shadow holds what the
+    // host holds; otherwise the whole range goes back on unmap.
+    buf->m_mapDirtyTracked =
+        shouldTrackMapDirtyPages(access, length) &&
+        (fetched || !ctx->m_state->isBufferHostMapDirty(ctx->m_state->getBuffer(target)));
+    if (buf->m_mapDirtyTracked) {
+        buf->m_mapSnapshot.assign(bits, bits + length);
+    } else {
+        buf->m_mapSnapshot.clear();
     }
 
     return bits;
@@ -3226,6 +3772,15 @@ void* GL2Encoder::s_glMapBufferRange(void* self, GLenum target, GLintptr offset,
 
     // end validation; actually do stuff now
 
+    if (access & GL_MAP_READ_BIT) {
+        ctx->fetchBufferShadow(target, boundBuffer, buf);
+    } else if (buf->m_shadowFree) {
+        // Shadow for the duration of the map only; unmap drops it again.
+        // Whatever the map does not invalidate must come from the host.
+        ctx->m_shared->setBufferShadowFree(boundBuffer, false);
+        ctx->m_state->setBufferHostMapDirty(boundBuffer, true);
+    }
+
     buf->m_mapped = true;
     buf->m_mappedAccess = access;
     buf->m_mappedOffset = offset;
@@ -3252,6 +3807,12 @@ void* GL2Encoder::s_glMapBufferRange(void* self, GLenum target, GLintptr offset,
             buf->dma_buffer.reset(&region);
         }
 
+        // Unmap diffs the DMA region against the shadow, which only works
+        // if the shadow is up to date.
+        buf->m_mapDirtyTracked =
+            shouldTrackMapDirtyPages(access, length) &&
+            !ctx->m_state->isBufferHostMapDirty(boundBuffer);
+
         ctx->glMapBufferRangeDMA(
                 ctx, target,
                 offset, length,
@@ -3277,9 +3838,34 @@ GLboolean GL2Encoder::s_glUnmapBuffer(void* self, GLenum target) {
     RET_AND_SET_ERROR_IF(!buf, GL_INVALID_VALUE, GL_FALSE);
     RET_AND_SET_ERROR_IF(!buf->m_mapped, GL_INVALID_OPERATION, GL_FALSE);
 
+    // For large write maps, find the pages that actually changed: against the
+    // map-time snapshot for shadow-backed maps, and against the (not yet
+    // updated) shadow for DMA maps.
+    std::vector<std::pair<GLintptr, GLsizeiptr> > dirtyRanges;
+    // Maps not tracked since map time send the whole range.
+    bool trackDirty = buf->m_mapDirtyTracked;
+    if (trackDirty && buf->dma_buffer.get().mapped_addr) {
+        getDirtyMapRanges(
+            reinterpret_cast<const char*>(buf->dma_buffer.get().mapped_addr),
+            &buf->m_fixedBuffer[buf->m_mappedOffset],
+            buf->m_mappedLength, &dirtyRanges);
+    } else if (trackDirty) {
+        getDirtyMapRanges(&buf->m_fixedBuffer[buf->m_mappedOffset],
+                          buf->m_mapSnapshot.data(),
+                          buf->m_mappedLength, &dirtyRanges);
+    }
+    buf->m_mapDirtyTracked = false;
+    buf->m_mapSnapshot.clear();
+
     if (buf->m_mappedAccess & GL_MAP_WRITE_BIT) {
         // invalide index range cache here
-        if (buf->m_mappedAccess & GL_MAP_INVALIDATE_BUFFER_BIT) {
+        if (trackDirty) {
+            for (size_t i = 0; i < dirtyRanges.size(); ++i) {
+                buf->m_indexRangeCache.invalidateRange(
+                    buf->m_mappedOffset + dirtyRanges[i].first,
+                    dirtyRanges[i].second);
+            }
+        } else if (buf->m_mappedAccess & GL_MAP_INVALIDATE_BUFFER_BIT) {
             buf->m_indexRangeCache.invalidateRange(0, buf->m_size);
         } else {
             buf->m_indexRangeCache.invalidateRange(buf->m_mappedOffset, buf->m_mappedLength);
@@ -3300,6 +3886,34 @@ GLboolean GL2Encoder::s_glUnmapBuffer(void* self, GLenum target) {
             buf->m_mappedAccess,
             goldfish_dma_guest_paddr(&buf->dma_buffer.get()),
             &host_res);
+    } else if (trackDirty &&
+               !(dirtyRanges.size() == 1 &&
+                 dirtyRanges[0].second == buf->m_mappedLength)) {
+        // The host does not keep buffers mapped between commands, so
+        // unmapping amounts to writing back the range; flush only the
+        // dirty pages instead (possibly none at all).
+        GLbitfield flushAccess =
+            (buf->m_mappedAccess | GL_MAP_FLUSH_EXPLICIT_BIT) &
+            ~(GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+        for (size_t i = 0; i < dirtyRanges.size(); ++i) {
+            GLintptr dirtyOffset = buf->m_mappedOffset + dirtyRanges[i].first;
+            if (ctx->m_hasAsyncUnmapBuffer) {
+                ctx->glFlushMappedBufferRangeAEMU2(
+                        ctx, target,
+                        dirtyOffset,
+                        dirtyRanges[i].second,
+                        flushAccess,
+                        &buf->m_fixedBuffer[dirtyOffset]);
+            } else {
+                ctx->glFlushMappedBufferRangeAEMU(
+                        ctx, target,
+                        dirtyOffset,
+                        dirtyRanges[i].second,
+                        flushAccess,
+                        &buf->m_fixedBuffer[dirtyOffset]);
+            }
+        }
     } else {
         if (ctx->m_hasAsyncUnmapBuffer) {
             ctx->glUnmapBufferAsyncAEMU(
@@ -3327,6 +3941,10 @@ GLboolean GL2Encoder::s_glUnmapBuffer(void* self, GLenum target) {
     buf->m_mappedOffset = 0;
     buf->m_mappedLength = 0;
 
+    if (ctx->canDropBufferShadow(target, boundBuffer, buf->m_size)) {
+        ctx->m_shared->setBufferShadowFree(boundBuffer, true);
+    }
+
     return host_res;
 }
 
@@ -3645,6 +4263,12 @@ void GL2Encoder::s_glCopyBufferSubData(void *self , GLenum readtarget, GLenum wr
                  GL_INVALID_VALUE);
 
     ctx->m_glCopyBufferSubData_enc(self, readtarget, writetarget, readoffset, writeoffset, size);
+
+    // The copy happens on the host only; a shadow of the destination is
+    // stale until the next map reads it back.
+    if (writeBufferData && !writeBufferData->m_shadowFree) {
+        ctx->m_state->setBufferHostMapDirty(writeBufferId, true);
+    }
 }
 
 void GL2Encoder::s_glGetBufferParameteriv(void* self, GLenum target, GLenum pname, GLint* params) {
@@ -4184,6 +4808,10 @@ void GL2Encoder::s_glTransformFeedbackVaryings(void* self, GLuint program, GLsiz
     SET_ERROR_IF(err != GL_NO_ERROR, GL_INVALID_OPERATION);
 
     ctx->glTransformFeedbackVaryingsAEMU(ctx, program, count, (const char*)&packed[0], packed.size() + 1, bufferMode);
+
+    char mode[16];
+    snprintf(mode, sizeof(mode), "0x%x:", bufferMode);
+    ctx->m_shared->setProgramLinkInput(program, "tfv", std::string(mode) + packed);
 }
 
 void GL2Encoder::s_glBeginTransformFeedback(void* self, GLenum primitiveMode) {
@@ -4301,6 +4929,15 @@ void GL2Encoder::s_glTexImage3D(void* self, GLenum target, GLint level, GLint in
                 ctx, target, level, internalFormat,
                 width, height, depth,
                 border, format, type, (uintptr_t)data);
+    } else if (data &&
+               ctx->m_state->pixelDataSize(width, height, depth, format, type, 0) >=
+                   kMinChunkedTextureUploadSize) {
+        ctx->m_glTexImage3D_enc(ctx,
+                target, level, internalFormat,
+                width, height, depth,
+                border, format, type, NULL);
+        ctx->texSubImage3DChunked(target, level, 0, 0, 0,
+                                  width, height, depth, format, type, data);
     } else {
         ctx->m_glTexImage3D_enc(ctx,
                 target, level, internalFormat,
@@ -4358,7 +4995,10 @@ void GL2Encoder::s_glTexSubImage3D(void* self, GLenum target, GLint level, GLint
                 xoffset, yoffset, zoffset,
                 width, height, depth,
                 format, type, (uintptr_t)data);
-    } else {
+    } else if (!ctx->texSubImage3DChunked(target, level,
+                                          xoffset, yoffset, zoffset,
+                                          width, height, depth,
+                                          format, type, data)) {
         ctx->m_glTexSubImage3D_enc(ctx,
                 target, level,
                 xoffset, yoffset, zoffset,
@@ -4568,7 +5208,7 @@ void GL2Encoder::s_glDrawArraysInstanced(void* self, GLenum mode, GLint first, G
         ctx->sendVertexAttributes(0, count, false, primcount);
         ctx->m_glDrawArraysInstanced_enc(ctx, mode, first, count, primcount);
     }
-    ctx->m_stream->flush();
+    ctx->flushDrawCall(count, primcount);
     ctx->m_state->postDraw();
 }
 
@@ -4607,6 +5247,7 @@ void GL2Encoder::s_glDrawElementsInstanced(void* self, GLenum mode, GLsizei coun
     // caching previous results.
     if (ctx->m_state->currentIndexVbo() != 0) {
         buf = ctx->m_shared->getBufferData(ctx->m_state->currentIndexVbo());
+        ctx->fetchBufferShadow(GL_ELEMENT_ARRAY_BUFFER, ctx->m_state->currentIndexVbo(), buf);
         offset = (GLintptr)indices;
         indices = &buf->m_fixedBuffer[offset];
         ctx->getBufferIndexRange(buf,
@@ -4635,7 +5276,6 @@ void GL2Encoder::s_glDrawElementsInstanced(void* self, GLenum mode, GLsizei coun
             ctx->sendVertexAttributes(0, maxIndex + 1, false, primcount);
             ctx->doBindBufferEncodeCached(GL_ELEMENT_ARRAY_BUFFER, ctx->m_state->currentIndexVbo());
             ctx->glDrawElementsInstancedOffsetAEMU(ctx, mode, count, type, offset, primcount);
-            ctx->flushDrawCall();
             adjustIndices = false;
         } else {
             ctx->doBindBufferEncodeCached(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -4651,7 +5291,6 @@ void GL2Encoder::s_glDrawElementsInstanced(void* self, GLenum mode, GLsizei coun
         if (has_indirect_arrays || 1) {
             ctx->sendVertexAttributes(minIndex, maxIndex - minIndex + 1, true, primcount);
             ctx->glDrawElementsInstancedDataAEMU(ctx, mode, count, type, adjustedIndices, primcount, count * glSizeof(type));
-            ctx->m_stream->flush();
             // XXX - OPTIMIZATION (see the other else branch) should be implemented
             if(!has_indirect_arrays) {
                 //ALOGD("unoptimized drawelements !!!\n");
@@ -4662,6 +5301,7 @@ void GL2Encoder::s_glDrawElementsInstanced(void* self, GLenum mode, GLsizei coun
             ALOGE("glDrawElements: direct index & direct buffer data - will be implemented in later versions;\n");
         }
     }
+    ctx->flushDrawCall(count, primcount);
     ctx->m_state->postDraw();
 }
 
@@ -4700,6 +5340,7 @@ void GL2Encoder::s_glDrawRangeElements(void* self, GLenum mode, GLuint start, GL
     // caching previous results.
     if (ctx->m_state->currentIndexVbo() != 0) {
         buf = ctx->m_shared->getBufferData(ctx->m_state->currentIndexVbo());
+        ctx->fetchBufferShadow(GL_ELEMENT_ARRAY_BUFFER, ctx->m_state->currentIndexVbo(), buf);
         ALOGV("%s: current index vbo: %p len %zu count %zu\n", __func__, buf, buf->m_fixedBuffer.size(), (size_t)count);
         offset = (GLintptr)indices;
         void* oldIndices = (void*)indices;
@@ -4734,7 +5375,6 @@ void GL2Encoder::s_glDrawRangeElements(void* self, GLenum mode, GLuint start, GL
             ctx->sendVertexAttributes(0, maxIndex + 1, false);
             ctx->doBindBufferEncodeCached(GL_ELEMENT_ARRAY_BUFFER, ctx->m_state->currentIndexVbo());
             ctx->glDrawElementsOffset(ctx, mode, count, type, offset);
-            ctx->flushDrawCall();
             adjustIndices = false;
         } else {
             ctx->doBindBufferEncodeCached(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -4750,7 +5390,6 @@ void GL2Encoder::s_glDrawRangeElements(void* self, GLenum mode, GLuint start, GL
         if (has_indirect_arrays || 1) {
             ctx->sendVertexAttributes(minIndex, maxIndex - minIndex + 1, true);
             ctx->glDrawElementsData(ctx, mode, count, type, adjustedIndices, count * glSizeof(type));
-            ctx->m_stream->flush();
             // XXX - OPTIMIZATION (see the other else branch) should be implemented
             if(!has_indirect_arrays) {
                 //ALOGD("unoptimized drawelements !!!\n");
@@ -4761,6 +5400,7 @@ void GL2Encoder::s_glDrawRangeElements(void* self, GLenum mode, GLuint start, GL
             ALOGE("glDrawElements: direct index & direct buffer data - will be implemented in later versions;\n");
         }
     }
+    ctx->flushDrawCall(count);
     ctx->m_state->postDraw();
 }
 
@@ -5176,6 +5816,7 @@ void GL2Encoder::s_glBindSampler(void* self, GLuint unit, GLuint sampler) {
 
 void GL2Encoder::s_glDeleteSamplers(void* self, GLsizei n, const GLuint* samplers) {
     GL2Encoder *ctx = (GL2Encoder *)self;
+    SET_ERROR_IF(n < 0, GL_INVALID_VALUE);
     ctx->m_state->onDeleteSamplers(n, samplers);
     ctx->m_state->setExistence(GLClientState::ObjectType::Sampler, false, n, samplers);
     ctx->m_glDeleteSamplers_enc(ctx, n, samplers);
@@ -5348,6 +5989,7 @@ void GL2Encoder::s_glGetBooleani_v(void* self, GLenum param, GLuint index, GLboo
 
 void GL2Encoder::s_glGetShaderiv(void* self, GLuint shader, GLenum pname, GLint* params) {
     GL2Encoder *ctx = (GL2Encoder *)self;
+    ctx->flushPendingShaderCompile(shader);
     ctx->m_glGetShaderiv_enc(self, shader, pname, params);
 
     SET_ERROR_IF(!GLESv2Validation::allowedGetShader(pname), GL_INVALID_ENUM);
@@ -5684,6 +6326,12 @@ void GL2Encoder::s_glProgramParameteri(void* self, GLuint program, GLenum pname,
     SET_ERROR_IF(pname != GL_PROGRAM_BINARY_RETRIEVABLE_HINT && pname != GL_PROGRAM_SEPARABLE, GL_INVALID_ENUM);
     SET_ERROR_IF(value != GL_FALSE && value != GL_TRUE, GL_INVALID_VALUE);
     ctx->m_glProgramParameteri_enc(self, program, pname, value);
+
+    char setting[32];
+    char valueStr[16];
+    snprintf(setting, sizeof(setting), "param:0x%x", pname);
+    snprintf(valueStr, sizeof(valueStr), "%d", value);
+    ctx->m_shared->setProgramLinkInput(program, setting, valueStr);
 }
 
 void GL2Encoder::s_glUseProgramStages(void *self, GLuint pipeline, GLbitfield stages, GLuint program)
@@ -5892,6 +6540,7 @@ void GL2Encoder::s_glDrawArraysIndirect(void* self, GLenum mode, const void* ind
         // This is purely for debug/dev purposes.
         ctx->glDrawArraysIndirectDataAEMU(ctx, mode, indirect, indirectStructSize);
     }
+    ctx->flushDrawCall(0);
     ctx->m_state->postDraw();
 }
 
@@ -5923,6 +6572,7 @@ void GL2Encoder::s_glDrawElementsIndirect(void* self, GLenum mode, GLenum type,
         // This is purely for debug/dev purposes.
         ctx->glDrawElementsIndirectDataAEMU(ctx, mode, type, indirect, indirectStructSize);
     }
+    ctx->flushDrawCall(0);
     ctx->m_state->postDraw();
 }
 
@@ -6026,12 +6676,14 @@ void GL2Encoder::s_glDispatchComputeIndirect(void* self, GLintptr indirect) {
 
 void GL2Encoder::s_glGenTransformFeedbacks(void* self, GLsizei n, GLuint* ids) {
     GL2Encoder *ctx = (GL2Encoder*)self;
+    SET_ERROR_IF(n < 0, GL_INVALID_VALUE);
     ctx->m_glGenTransformFeedbacks_enc(ctx, n, ids);
     ctx->m_state->setExistence(GLClientState::ObjectType::TransformFeedback, true, n, ids);
 }
 
 void GL2Encoder::s_glDeleteTransformFeedbacks(void* self, GLsizei n, const GLuint* ids) {
     GL2Encoder *ctx = (GL2Encoder*)self;
+    SET_ERROR_IF(n < 0, GL_INVALID_VALUE);
     SET_ERROR_IF(ctx->m_state->getTransformFeedbackActive(), GL_INVALID_OPERATION);
 
     ctx->m_state->setExistence(GLClientState::ObjectType::TransformFeedback, false, n, ids);
@@ -6040,18 +6692,21 @@ void GL2Encoder::s_glDeleteTransformFeedbacks(void* self, GLsizei n, const GLuin
 
 void GL2Encoder::s_glGenSamplers(void* self, GLsizei n, GLuint* ids) {
     GL2Encoder *ctx = (GL2Encoder*)self;
+    SET_ERROR_IF(n < 0, GL_INVALID_VALUE);
     ctx->m_glGenSamplers_enc(ctx, n, ids);
     ctx->m_state->setExistence(GLClientState::ObjectType::Sampler, true, n, ids);
 }
 
 void GL2Encoder::s_glGenQueries(void* self, GLsizei n, GLuint* ids) {
     GL2Encoder *ctx = (GL2Encoder*)self;
+    SET_ERROR_IF(n < 0, GL_INVALID_VALUE);
     ctx->m_glGenQueries_enc(ctx, n, ids);
     ctx->m_state->setExistence(GLClientState::ObjectType::Query, true, n, ids);
 }
 
 void GL2Encoder::s_glDeleteQueries(void* self, GLsizei n, const GLuint* ids) {
     GL2Encoder *ctx = (GL2Encoder*)self;
+    SET_ERROR_IF(n < 0, GL_INVALID_VALUE);
     ctx->m_state->setExistence(GLClientState::ObjectType::Query, false, n, ids);
     ctx->m_glDeleteQueries_enc(ctx, n, ids);
 }
@@ -6102,6 +6757,8 @@ void GL2Encoder::s_glClear(void* self, GLbitfield mask) {
     GLbitfield allowed_bits = GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT;
     GLbitfield has_disallowed_bits = (mask & ~allowed_bits);
     SET_ERROR_IF(has_disallowed_bits, GL_INVALID_VALUE);
+    SET_ERROR_IF(ctx->s_glCheckFramebufferStatus(ctx, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE,
+                 GL_INVALID_FRAMEBUFFER_OPERATION);
 
     ctx->m_glClear_enc(ctx, mask);
 }
@@ -6187,6 +6844,18 @@ void GL2Encoder::s_glCompileShader(void* self, GLuint shader) {
     SET_ERROR_IF(isShaderOrProgramObject && !isShader, GL_INVALID_OPERATION);
     SET_ERROR_IF(!isShaderOrProgramObject && !isShader, GL_INVALID_VALUE);
 
+    // With the program binary cache, compiles are deferred until something
+    // needs the result; a cache hit at link time skips them entirely.
+    if (ctx->programBinaryCacheEnabled()) {
+        ShaderData* shaderData = ctx->m_shared->getShaderData(shader);
+        if (shaderData) {
+            shaderData->compiledSources = shaderData->sources;
+            shaderData->compiled = true;
+            shaderData->compilePending = true;
+            return;
+        }
+    }
+
     ctx->m_glCompileShader_enc(ctx, shader);
 }
 
@@ -6206,6 +6875,8 @@ void GL2Encoder::s_glProgramBinary(void *self , GLuint program, GLenum binaryFor
     SET_ERROR_IF(~0 == binaryFormat, GL_INVALID_ENUM);
 
     ctx->m_glProgramBinary_enc(self, program, binaryFormat, binary, length);
+    // Loading a binary relinks the program, or leaves it unlinked.
+    ctx->m_shared->clearProgramCachedLocations(program);
 }
 
 void GL2Encoder::s_glGetSamplerParameterfv(void *self, GLuint sampler, GLenum pname, GLfloat* params) {
@@ -6281,7 +6952,40 @@ int GL2Encoder::s_glGetAttribLocation(void *self , GLuint program, const GLchar*
     RET_AND_SET_ERROR_IF(!isProgram, GL_INVALID_OPERATION, -1);
     RET_AND_SET_ERROR_IF(!ctx->m_shared->getProgramLinkStatus(program), GL_INVALID_OPERATION, -1);
 
-    return ctx->m_glGetAttribLocation_enc(ctx, program, name);
+    if (!name) return ctx->m_glGetAttribLocation_enc(ctx, program, name);
+
+    GLint location;
+    if (ctx->m_shared->getProgramCachedLocation(
+            program, ProgramData::LOCATION_ATTRIB, name, &location)) {
+        return location;
+    }
+
+    location = ctx->m_glGetAttribLocation_enc(ctx, program, name);
+    ctx->m_shared->setProgramCachedLocation(
+        program, ProgramData::LOCATION_ATTRIB, name, location);
+    return location;
+}
+
+GLuint GL2Encoder::s_glGetUniformBlockIndex(void *self , GLuint program, const GLchar* uniformBlockName) {
+    GL2Encoder *ctx = (GL2Encoder*)self;
+
+    VALIDATE_PROGRAM_NAME_RET(program, GL_INVALID_INDEX);
+
+    // Unlinked programs have no blocks; let the host answer those.
+    if (!uniformBlockName || !ctx->m_shared->getProgramLinkStatus(program)) {
+        return ctx->m_glGetUniformBlockIndex_enc(ctx, program, uniformBlockName);
+    }
+
+    GLint index;
+    if (ctx->m_shared->getProgramCachedLocation(
+            program, ProgramData::LOCATION_UNIFORM_BLOCK, uniformBlockName, &index)) {
+        return (GLuint)index;
+    }
+
+    index = (GLint)ctx->m_glGetUniformBlockIndex_enc(ctx, program, uniformBlockName);
+    ctx->m_shared->setProgramCachedLocation(
+        program, ProgramData::LOCATION_UNIFORM_BLOCK, uniformBlockName, index);
+    return (GLuint)index;
 }
 
 void GL2Encoder::s_glBindAttribLocation(void *self , GLuint program, GLuint index, const GLchar* name) {
@@ -6297,6 +7001,11 @@ void GL2Encoder::s_glBindAttribLocation(void *self , GLuint program, GLuint inde
 
     fprintf(stderr, "%s: bind attrib %u name %s\n", __func__, index, name);
     ctx->m_glBindAttribLocation_enc(ctx, program, index, name);
+
+    char indexStr[16];
+    snprintf(indexStr, sizeof(indexStr), "%u", index);
+    ctx->m_shared->setProgramLinkInput(program,
+        std::string("attrib:") + (name ? name : ""), indexStr);
 }
 
 // TODO-SLOW
@@ -6536,7 +7245,35 @@ void GL2Encoder::s_glGetShaderPrecisionFormat(void *self , GLenum shadertype, GL
     GL2Encoder* ctx = (GL2Encoder*)self;
     SET_ERROR_IF(!GLESv2Validation::allowedShaderType(shadertype), GL_INVALID_ENUM);
     SET_ERROR_IF(!GLESv2Validation::allowedPrecisionType(precisiontype), GL_INVALID_ENUM);
-    ctx->m_glGetShaderPrecisionFormat_enc(ctx, shadertype, precisiontype, range, precision);
+
+    int shaderIndex = shadertype == GL_FRAGMENT_SHADER ? 1 : 0;
+    int precisionIndex = precisiontype - GL_LOW_FLOAT;
+    GLint format[3];
+    bool cached = false;
+    {
+        android::AutoMutex _lock(sImmutableStateLock);
+        if (sImmutableState.shaderPrecisionFormatsFetched[shaderIndex][precisionIndex]) {
+            memcpy(format, sImmutableState.shaderPrecisionFormats[shaderIndex][precisionIndex],
+                   sizeof(format));
+            cached = true;
+        }
+    }
+    if (!cached) {
+        // Not under the lock, so that other threads are not held up by
+        // this round trip.
+        ctx->m_glGetShaderPrecisionFormat_enc(ctx, shadertype, precisiontype,
+                                              format, format + 2);
+
+        android::AutoMutex _lock(sImmutableStateLock);
+        memcpy(sImmutableState.shaderPrecisionFormats[shaderIndex][precisionIndex], format,
+               sizeof(format));
+        sImmutableState.shaderPrecisionFormatsFetched[shaderIndex][precisionIndex] = true;
+    }
+    if (range) {
+        range[0] = format[0];
+        range[1] = format[1];
+    }
+    if (precision) *precision = format[2];
 }
 
 void GL2Encoder::s_glGetProgramiv(void *self , GLuint program, GLenum pname, GLint* params) {
@@ -6641,3 +7378,47 @@ void GL2Encoder::s_glClearStencil(void* self, int v) {
     ctx->m_state->state_GL_STENCIL_CLEAR_VALUE = v;
     ctx->m_glClearStencil_enc(ctx, v);
 }
+
+void GL2Encoder::s_glGenTextures(void* self, GLsizei n, GLuint* textures) {
+    GL2Encoder* ctx = (GL2Encoder*)self;
+    SET_ERROR_IF(n < 0, GL_INVALID_VALUE);
+    ctx->m_glGenTextures_enc(ctx, n, textures);
+}
+
+void GL2Encoder::s_glGenProgramPipelines(void* self, GLsizei n, GLuint* pipelines) {
+    GL2Encoder* ctx = (GL2Encoder*)self;
+    SET_ERROR_IF(n < 0, GL_INVALID_VALUE);
+    ctx->m_glGenProgramPipelines_enc(ctx, n, pipelines);
+}
+
+void GL2Encoder::s_glDeleteProgramPipelines(void* self, GLsizei n, const GLuint* pipelines) {
+    GL2Encoder* ctx = (GL2Encoder*)self;
+    SET_ERROR_IF(n < 0, GL_INVALID_VALUE);
+    ctx->m_glDeleteProgramPipelines_enc(ctx, n, pipelines);
+}
+
+void GL2Encoder::s_glMemoryBarrier(void* self, GLbitfield barriers) {
+    GL2Encoder* ctx = (GL2Encoder*)self;
+    SET_ERROR_IF(!GLESv2Validation::allowedMemoryBarrier(barriers, false /* not by region */), GL_INVALID_VALUE);
+    ctx->m_glMemoryBarrier_enc(ctx, barriers);
+}
+
+void GL2Encoder::s_glMemoryBarrierByRegion(void* self, GLbitfield barriers) {
+    GL2Encoder* ctx = (GL2Encoder*)self;
+    SET_ERROR_IF(!GLESv2Validation::allowedMemoryBarrier(barriers, true /* by region */), GL_INVALID_VALUE);
+    ctx->m_glMemoryBarrierByRegion_enc(ctx, barriers);
+}
+
+void GL2Encoder::s_glBindImageTexture(void* self, GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format) {
+    GL2Encoder* ctx = (GL2Encoder*)self;
+    GLint maxImageUnits;
+    ctx->glGetIntegerv(ctx, GL_MAX_IMAGE_UNITS, &maxImageUnits);
+    SET_ERROR_IF(unit >= (GLuint)maxImageUnits, GL_INVALID_VALUE);
+    SET_ERROR_IF(texture && !ctx->m_state->isTexture(texture), GL_INVALID_VALUE);
+    SET_ERROR_IF(texture && !ctx->m_state->isTextureImmutable(texture), GL_INVALID_OPERATION);
+    SET_ERROR_IF(level < 0, GL_INVALID_VALUE);
+    SET_ERROR_IF(layer < 0, GL_INVALID_VALUE);
+    SET_ERROR_IF(!GLESv2Validation::allowedImageAccess(access), GL_INVALID_ENUM);
+    SET_ERROR_IF(!GLESv2Validation::allowedImageFormat(format), GL_INVALID_VALUE);
+    ctx->m_glBindImageTexture_enc(ctx, unit, texture, level, layered, layer, access, format);
+}
@@ -21,10 +21,13 @@
 #include "gl2_enc.h"
 #include "GLClientState.h"
 #include "GLSharedGroup.h"
+#include "ProgramBinaryCache.h"
 
 #include <string>
 #include <vector>
 
+struct GL2ImmutableValue;
+
 class GL2Encoder : public gl2_encoder_context_t {
 public:
     GL2Encoder(IOStream *stream, ChecksumCalculator* protocol);
@@ -32,6 +35,9 @@ public:
     void setDrawCallFlushInterval(uint32_t interval) {
         m_drawCallFlushInterval = interval;
     }
+    void setAdaptiveDrawCallFlush(bool adaptive) {
+        m_adaptiveDrawCallFlush = adaptive;
+    }
     void setHasAsyncUnmapBuffer(int version) {
         m_hasAsyncUnmapBuffer = version;
     }
@@ -41,6 +47,18 @@ public:
     void setNoHostError(bool noHostError) {
         m_noHostError = noHostError;
     }
+    void setGuestOnlyErrors(bool guestOnly) {
+        m_guestOnlyErrors = guestOnly;
+    }
+    void setVerifyGuestErrors(bool verify) {
+        m_verifyGuestErrors = verify;
+    }
+    void setProgramBinaryCache(ProgramBinaryCache* cache) {
+        m_programBinaryCache = cache;
+    }
+    void setShadowFreeBufferMinSize(GLsizeiptr size) {
+        m_shadowFreeBufferMinSize = size;
+    }
     void setClientState(GLClientState *state) {
         m_state = state;
     }
@@ -75,8 +93,12 @@ public:
     int minorVersion() const { return m_currMinorVersion; }
     void setExtensions(const char* exts,
                        const std::vector<std::string>& extArray) {
-        m_currExtensions = std::string(exts);
-        m_currExtensionsArray = extArray;
+        // Contexts of a process mostly share one extension string; switching
+        // between them need not copy it again.
+        if (m_currExtensions != exts) {
+            m_currExtensions = std::string(exts);
+            m_currExtensionsArray = extArray;
+        }
         m_state->setExtensions(m_currExtensions);
     }
     bool hasExtension(const char* ext) const {
@@ -89,6 +111,19 @@ public:
     void setInitialized(){ m_initialized = true; };
     bool isInitialized(){ return m_initialized; };
 
+    // What flushDrawCall() did during one frame, by reason of each flush.
+    struct DrawCallFlushStats {
+        uint32_t draws;
+        uint32_t flushes;
+        uint32_t frameStartFlushes;
+        uint32_t pendingBytesFlushes;
+        uint32_t drawCostFlushes;
+        uint32_t delayFlushes;
+        uint32_t intervalFlushes;
+    };
+    // Called at eglSwapBuffers. Returns the stats of the frame that ended.
+    DrawCallFlushStats onFrameEnd();
+
     virtual void setError(GLenum error){ m_error = error; };
     virtual GLenum getError() { return m_error; };
 
@@ -119,6 +154,8 @@ private:
     bool    m_hasSyncBufferData;
     bool    m_initialized;
     bool    m_noHostError;
+    bool    m_guestOnlyErrors;
+    bool    m_verifyGuestErrors;
     GLClientState *m_state;
     GLSharedGroupPtr m_shared;
     GLenum  m_error;
@@ -153,12 +190,35 @@ private:
 
     std::vector<char> m_fixedBuffer;
 
+    // Draw call flush policy. With m_adaptiveDrawCallFlush, the stream is
+    // also flushed early in a frame, and when the commands, the vertices or
+    // the time since the last flush add up; otherwise only every
+    // m_drawCallFlushInterval draws.
     uint32_t m_drawCallFlushInterval;
     uint32_t m_drawCallFlushCount;
+    bool m_adaptiveDrawCallFlush;
+    uint64_t m_drawCallFlushCost;
+    uint64_t m_lastDrawCallFlushNs;
+    uint32_t m_frameDrawCalls;
+    DrawCallFlushStats m_drawCallFlushStats;
 
     bool m_primitiveRestartEnabled;
     GLuint m_primitiveRestartIndex;
 
+    // Program binary cache; NULL unless enabled for this process.
+    ProgramBinaryCache* m_programBinaryCache;
+    GLint m_numProgramBinaryFormats;
+    bool programBinaryCacheEnabled();
+    bool linkProgramFromCache(GLuint program, uint64_t key);
+    void storeProgramBinary(GLuint program, uint64_t key);
+    void flushPendingShaderCompile(GLuint shader);
+
+    // Buffers at least this large that are never used as index buffers or
+    // mapped for reading keep no guest shadow. 0 disables.
+    GLsizeiptr m_shadowFreeBufferMinSize;
+    bool canDropBufferShadow(GLenum target, GLuint bufferId, GLsizeiptr size);
+    void fetchBufferShadow(GLenum target, GLuint bufferId, BufferData* buf);
+
     void calcIndexRange(const void* indices,
                         GLenum type, GLsizei count,
                         int* minIndex, int* maxIndex);
@@ -170,7 +230,20 @@ private:
                              int* minIndex_out, int* maxIndex_out);
     void getVBOUsage(bool* hasClientArrays, bool* hasVBOs) const;
     void sendVertexAttributes(GLint first, GLsizei count, bool hasClientArrays, GLsizei primcount = 0);
-    void flushDrawCall();
+    // |count| * |primcount| vertices approximate the host cost of the draw.
+    void flushDrawCall(GLsizei count, GLsizei primcount = 1);
+
+    // Large client memory texture uploads are sent as several sub-image
+    // commands of a few rows or images each. Returns false, having encoded
+    // nothing, if the upload is too small to be worth splitting.
+    bool texSubImage2DChunked(GLenum target, GLint level,
+                              GLint xoffset, GLint yoffset,
+                              GLsizei width, GLsizei height,
+                              GLenum format, GLenum type, const GLvoid* pixels);
+    bool texSubImage3DChunked(GLenum target, GLint level,
+                              GLint xoffset, GLint yoffset, GLint zoffset,
+                              GLsizei width, GLsizei height, GLsizei depth,
+                              GLenum format, GLenum type, const GLvoid* pixels);
 
     bool updateHostTexture2DBinding(GLenum texUnit, GLenum newTarget);
     void updateHostTexture2DBindingsFromProgramData(GLuint program);
@@ -181,6 +254,16 @@ private:
     class ErrorUpdater;
     template<class T> class ScopedQueryUpdate;
     
+    // Values that never change for a host renderer (implementation limits,
+    // shader precision formats and compressed texture formats) are kept in
+    // a process-wide table, each filled in by the first query for it.
+    // NULL if |param| is not such a value, or the host rejected it.
+    const GL2ImmutableValue* getImmutableValue(GLenum param);
+    bool getImmutableIntegerv(GLenum param, GLint *val);
+    bool getImmutableFloatv(GLenum param, GLfloat *val);
+    // Local if possible, else safe_glGetIntegerv().
+    void immutable_glGetIntegerv(GLenum param, GLint *val);
+
     // General queries
     void safe_glGetBooleanv(GLenum param, GLboolean *val);
     void safe_glGetFloatv(GLenum param, GLfloat *val);
@@ -850,6 +933,9 @@ private:
     static int s_glGetAttribLocation(void *self , GLuint program, const GLchar* name);
     glGetAttribLocation_client_proc_t m_glGetAttribLocation_enc;
 
+    static GLuint s_glGetUniformBlockIndex(void *self , GLuint program, const GLchar* uniformBlockName);
+    glGetUniformBlockIndex_client_proc_t m_glGetUniformBlockIndex_enc;
+
     static void s_glBindAttribLocation(void *self , GLuint program, GLuint index, const GLchar* name);
     static void s_glUniformBlockBinding(void *self , GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding);
     static void s_glGetTransformFeedbackVarying(void *self , GLuint program, GLuint index, GLsizei bufSize, GLsizei* length, GLsizei* size, GLenum* type, char* name);
@@ -897,6 +983,13 @@ private:
     static void s_glStencilMask(void* self, GLuint mask);
     static void s_glClearStencil(void* self, int v);
 
+    static void s_glGenTextures(void* self, GLsizei n, GLuint* textures);
+    static void s_glGenProgramPipelines(void* self, GLsizei n, GLuint* pipelines);
+    static void s_glDeleteProgramPipelines(void* self, GLsizei n, const GLuint* pipelines);
+    static void s_glMemoryBarrier(void* self, GLbitfield barriers);
+    static void s_glMemoryBarrierByRegion(void* self, GLbitfield barriers);
+    static void s_glBindImageTexture(void* self, GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format);
+
 #define LIST_REMAINING_FUNCTIONS_FOR_VALIDATION(f) \
     f(glBindAttribLocation) \
     f(glUniformBlockBinding) \
@@ -942,6 +1035,12 @@ private:
     f(glGetFragDataLocation) \
     f(glStencilMask) \
     f(glClearStencil) \
+    f(glGenTextures) \
+    f(glGenProgramPipelines) \
+    f(glDeleteProgramPipelines) \
+    f(glMemoryBarrier) \
+    f(glMemoryBarrierByRegion) \
+    f(glBindImageTexture) \
 
 #define DECLARE_CLIENT_ENCODER_PROC(n) \
     n##_client_proc_t m_##n##_enc;
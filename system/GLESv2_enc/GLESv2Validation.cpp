@@ -1592,4 +1592,62 @@ bool allowedHintMode(GLenum mode) {
     }
 }
 
+bool allowedMemoryBarrier(GLbitfield barriers, bool byRegion) {
+    if (barriers == GL_ALL_BARRIER_BITS) return true;
+
+    GLbitfield allowed =
+        GL_ATOMIC_COUNTER_BARRIER_BIT |
+        GL_FRAMEBUFFER_BARRIER_BIT |
+        GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+        GL_SHADER_STORAGE_BARRIER_BIT |
+        GL_TEXTURE_FETCH_BARRIER_BIT |
+        GL_UNIFORM_BARRIER_BIT;
+
+    if (!byRegion) {
+        allowed |=
+            GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+            GL_ELEMENT_ARRAY_BARRIER_BIT |
+            GL_COMMAND_BARRIER_BIT |
+            GL_PIXEL_BUFFER_BARRIER_BIT |
+            GL_TEXTURE_UPDATE_BARRIER_BIT |
+            GL_BUFFER_UPDATE_BARRIER_BIT |
+            GL_TRANSFORM_FEEDBACK_BARRIER_BIT;
+    }
+
+    return !(barriers & ~allowed);
+}
+
+bool allowedImageAccess(GLenum access) {
+    switch (access) {
+        case GL_READ_ONLY:
+        case GL_WRITE_ONLY:
+        case GL_READ_WRITE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// OpenGL ES 3.1 table 8.27
+bool allowedImageFormat(GLenum format) {
+    switch (format) {
+        case GL_RGBA32F:
+        case GL_RGBA16F:
+        case GL_R32F:
+        case GL_RGBA32UI:
+        case GL_RGBA16UI:
+        case GL_RGBA8UI:
+        case GL_R32UI:
+        case GL_RGBA32I:
+        case GL_RGBA16I:
+        case GL_RGBA8I:
+        case GL_R32I:
+        case GL_RGBA8:
+        case GL_RGBA8_SNORM:
+            return true;
+        default:
+            return false;
+    }
+}
+
 } // namespace GLESv2Validation
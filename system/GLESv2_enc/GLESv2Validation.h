@@ -117,6 +117,11 @@ bool allowedGetSyncParam(GLenum pname);
 bool allowedHintTarget(GLenum target);
 bool allowedHintMode(GLenum pname);
 
+bool allowedMemoryBarrier(GLbitfield barriers, bool byRegion);
+
+bool allowedImageAccess(GLenum access);
+bool allowedImageFormat(GLenum format);
+
 } // namespace GLESv2Validation
 
 #endif
@@ -13,10 +13,12 @@ $(call emugl-export,HEADER_LIBRARIES,libgralloc_cb.ranchu)
 endif
 
 LOCAL_SRC_FILES := \
+    EncoderStatsStream.cpp \
     FormatConversions.cpp \
     HostConnection.cpp \
     QemuPipeStream.cpp \
     ProcessPipe.cpp    \
+    ThreadedStream.cpp \
     ThreadInfo.cpp \
 
 ifeq (true,$(GFXSTREAM))
@@ -0,0 +1,261 @@
+/*
+* Copyright (C) 2021 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "EncoderStatsStream.h"
+
+#if PLATFORM_SDK_VERSION < 26
+#include <cutils/log.h>
+#else
+#include <log/log.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <vector>
+
+#include <inttypes.h>
+#include <string.h>
+
+static const size_t kDumpEntries = 20;
+
+namespace {
+
+// Streams of all threads, and what streams of finished threads counted.
+struct StatsRegistry {
+    std::mutex lock;
+    std::set<EncoderStatsStream*> live;
+    EncoderStatsStream::StatsTable retired;
+    uint32_t dumpIntervalFrames = 0;
+    uint64_t frames = 0;
+};
+
+StatsRegistry* getRegistry() {
+    static StatsRegistry* registry = new StatsRegistry;
+    return registry;
+}
+
+std::atomic<bool> sStatsEnabled(false);
+
+// Opcode ranges are fixed by the *_opcodes.h headers of each encoder.
+const char* apiForOpcode(uint32_t opcode) {
+    if (opcode < 2048) return "gles1";
+    if (opcode < 10000) return "gles2";
+    if (opcode < 20000) return "rc";
+    return "vulkan";
+}
+
+} // namespace
+
+EncoderStatsStream::EncoderStatsStream(IOStream* stream, uint32_t dumpIntervalFrames) :
+    IOStream(0),
+    m_stream(stream),
+    m_buf(NULL),
+    m_headerSize(0),
+    m_packetRemaining(0),
+    m_lastOpcode(0),
+    m_lastOpcodeReadBack(true),
+    m_desynced(false)
+{
+    StatsRegistry* registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry->lock);
+    registry->live.insert(this);
+    registry->dumpIntervalFrames = dumpIntervalFrames;
+    sStatsEnabled.store(true, std::memory_order_relaxed);
+}
+
+EncoderStatsStream::~EncoderStatsStream()
+{
+    {
+        StatsRegistry* registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry->lock);
+        registry->live.erase(this);
+
+        std::lock_guard<std::mutex> statsLock(m_lock);
+        for (StatsTable::const_iterator it = m_stats.begin(); it != m_stats.end(); ++it) {
+            registry->retired[it->first].add(it->second);
+        }
+    }
+
+    m_stream->decRef();
+}
+
+size_t EncoderStatsStream::idealAllocSize(size_t len)
+{
+    return m_stream->idealAllocSize(len);
+}
+
+void *EncoderStatsStream::allocBuffer(size_t minSize)
+{
+    m_buf = (unsigned char*)m_stream->allocBuffer(minSize);
+    return m_buf;
+}
+
+int EncoderStatsStream::commitBuffer(size_t size)
+{
+    account(m_buf, size);
+    return m_stream->commitBuffer(size);
+}
+
+const unsigned char *EncoderStatsStream::readFully(void *buf, size_t len)
+{
+    accountRoundTrip();
+    return m_stream->readFully(buf, len);
+}
+
+const unsigned char *EncoderStatsStream::commitBufferAndReadFully(
+    size_t size, void *buf, size_t len)
+{
+    account(m_buf, size);
+    accountRoundTrip();
+    return m_stream->commitBufferAndReadFully(size, buf, len);
+}
+
+const unsigned char *EncoderStatsStream::read(void *buf, size_t *inout_len)
+{
+    accountRoundTrip();
+    return m_stream->read(buf, inout_len);
+}
+
+int EncoderStatsStream::writeFully(const void *buf, size_t len)
+{
+    account(buf, len);
+    return m_stream->writeFully(buf, len);
+}
+
+int EncoderStatsStream::writeFullyAsync(const void *buf, size_t len)
+{
+    account(buf, len);
+    return m_stream->writeFullyAsync(buf, len);
+}
+
+void EncoderStatsStream::account(const void* buf, size_t len)
+{
+    if (m_desynced || !len) return;
+
+    const unsigned char* ptr = (const unsigned char*)buf;
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    while (len) {
+        if (m_packetRemaining) {
+            size_t skip = std::min(len, m_packetRemaining);
+            m_packetRemaining -= skip;
+            ptr += skip;
+            len -= skip;
+            continue;
+        }
+
+        // Headers may be split across commits.
+        size_t copy = std::min(len, sizeof(m_header) - m_headerSize);
+        memcpy(m_header + m_headerSize, ptr, copy);
+        m_headerSize += copy;
+        ptr += copy;
+        len -= copy;
+        if (m_headerSize < sizeof(m_header)) break;
+        m_headerSize = 0;
+
+        uint32_t opcode, packetSize;
+        memcpy(&opcode, m_header, 4);
+        memcpy(&packetSize, m_header + 4, 4);
+        if (packetSize < sizeof(m_header)) {
+            ALOGE("%s: bad packet size %u for opcode %u, stopping encoder stats\n",
+                  __func__, packetSize, opcode);
+            m_desynced = true;
+            return;
+        }
+
+        OpcodeStats& stats = m_stats[opcode];
+        ++stats.calls;
+        stats.bytes += packetSize;
+        m_packetRemaining = packetSize - sizeof(m_header);
+        m_lastOpcode = opcode;
+        m_lastOpcodeReadBack = false;
+    }
+}
+
+void EncoderStatsStream::accountRoundTrip()
+{
+    if (m_desynced || m_lastOpcodeReadBack) return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    ++m_stats[m_lastOpcode].roundTrips;
+    m_lastOpcodeReadBack = true;
+}
+
+// static
+void EncoderStatsStream::getProcessStats(StatsTable* table, OpcodeStats* totals)
+{
+    StatsRegistry* registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry->lock);
+
+    *table = registry->retired;
+    for (std::set<EncoderStatsStream*>::const_iterator it = registry->live.begin();
+         it != registry->live.end(); ++it) {
+        std::lock_guard<std::mutex> statsLock((*it)->m_lock);
+        for (StatsTable::const_iterator s = (*it)->m_stats.begin();
+             s != (*it)->m_stats.end(); ++s) {
+            (*table)[s->first].add(s->second);
+        }
+    }
+
+    *totals = OpcodeStats();
+    for (StatsTable::const_iterator it = table->begin(); it != table->end(); ++it) {
+        totals->add(it->second);
+    }
+}
+
+// static
+void EncoderStatsStream::dump(size_t maxEntries)
+{
+    StatsTable table;
+    OpcodeStats totals;
+    getProcessStats(&table, &totals);
+
+    std::vector<std::pair<uint32_t, OpcodeStats> > entries(table.begin(), table.end());
+    std::sort(entries.begin(), entries.end(),
+              [](const std::pair<uint32_t, OpcodeStats>& a,
+                 const std::pair<uint32_t, OpcodeStats>& b) {
+                  return a.second.bytes > b.second.bytes;
+              });
+
+    ALOGI("encoder stats: %" PRIu64 " calls, %" PRIu64 " bytes, %" PRIu64 " round trips\n",
+          totals.calls, totals.bytes, totals.roundTrips);
+    for (size_t i = 0; i < entries.size() && i < maxEntries; ++i) {
+        const OpcodeStats& stats = entries[i].second;
+        ALOGI("  %s opcode %u: %" PRIu64 " calls, %" PRIu64 " bytes, %" PRIu64 " round trips\n",
+              apiForOpcode(entries[i].first), entries[i].first,
+              stats.calls, stats.bytes, stats.roundTrips);
+    }
+}
+
+// static
+bool EncoderStatsStream::onFrameEnd(OpcodeStats* totals)
+{
+    if (!sStatsEnabled.load(std::memory_order_relaxed)) return false;
+
+    StatsTable table;
+    getProcessStats(&table, totals);
+
+    bool shouldDump;
+    {
+        StatsRegistry* registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry->lock);
+        ++registry->frames;
+        shouldDump = registry->dumpIntervalFrames &&
+                     !(registry->frames % registry->dumpIntervalFrames);
+    }
+
+    if (shouldDump) dump(kDumpEntries);
+    return true;
+}
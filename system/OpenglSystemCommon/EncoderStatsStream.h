@@ -0,0 +1,95 @@
+/*
+* Copyright (C) 2021 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef __ENCODER_STATS_STREAM_H
+#define __ENCODER_STATS_STREAM_H
+
+/* This file implements an IOStream that passes everything through to the
+ * connection's stream, and counts calls, encoded bytes and blocking
+ * readbacks per opcode on the way.
+ *
+ * All encoders (renderControl, GLES 1, GLES 2/3 and Vulkan) frame each
+ * command as a 32-bit opcode followed by the 32-bit size of the whole
+ * packet. The stream follows these headers across commits and writes, so
+ * the generated encoders need no changes. Any read is charged to the last
+ * command that was encoded, once per command.
+ */
+#include <map>
+#include <mutex>
+
+#include <stdint.h>
+
+#include "IOStream.h"
+
+class EncoderStatsStream : public IOStream {
+public:
+    struct OpcodeStats {
+        uint64_t calls = 0;
+        uint64_t bytes = 0;
+        uint64_t roundTrips = 0;
+
+        void add(const OpcodeStats& other) {
+            calls += other.calls;
+            bytes += other.bytes;
+            roundTrips += other.roundTrips;
+        }
+    };
+
+    typedef std::map<uint32_t, OpcodeStats> StatsTable;
+
+    // Takes over the caller's reference to |stream|. If |dumpIntervalFrames|
+    // is not 0, onFrameEnd() logs the process totals that often.
+    EncoderStatsStream(IOStream* stream, uint32_t dumpIntervalFrames);
+    ~EncoderStatsStream();
+
+    virtual size_t idealAllocSize(size_t len);
+    virtual void *allocBuffer(size_t minSize);
+    virtual int commitBuffer(size_t size);
+    virtual const unsigned char *readFully( void *buf, size_t len);
+    virtual const unsigned char *commitBufferAndReadFully(size_t size, void *buf, size_t len);
+    virtual const unsigned char *read( void *buf, size_t *inout_len);
+    virtual int writeFully(const void *buf, size_t len);
+    virtual int writeFullyAsync(const void *buf, size_t len);
+
+    // Sums the tables of all live streams and of streams already destroyed.
+    static void getProcessStats(StatsTable* table, OpcodeStats* totals);
+    // Logs the |maxEntries| opcodes with the most encoded bytes.
+    static void dump(size_t maxEntries);
+    // Called once per eglSwapBuffers. Returns false if no stream collects
+    // stats; otherwise fills |totals| for counter tracks and dumps
+    // periodically.
+    static bool onFrameEnd(OpcodeStats* totals);
+
+private:
+    void account(const void* buf, size_t len);
+    void accountRoundTrip();
+
+    IOStream* m_stream;
+    unsigned char* m_buf;
+
+    // Parser state, only touched by the thread that owns the connection.
+    unsigned char m_header[8];
+    size_t m_headerSize;
+    size_t m_packetRemaining;
+    uint32_t m_lastOpcode;
+    bool m_lastOpcodeReadBack;
+    bool m_desynced;
+
+    // Guards m_stats, which getProcessStats() reads from other threads.
+    std::mutex m_lock;
+    StatsTable m_stats;
+};
+
+#endif
@@ -16,6 +16,9 @@
 #include "HostConnection.h"
 
 #include "cutils/properties.h"
+#include "EncoderStatsStream.h"
+#include "ProgramBinaryCache.h"
+#include "ThreadedStream.h"
 
 #ifdef HOST_BUILD
 #include "android/base/Tracing.h"
@@ -29,6 +32,7 @@ class GLEncoder : public gl_client_context_t {
 public:
     GLEncoder(IOStream*, ChecksumCalculator*) { }
     void setContextAccessor(gl_client_context_t *()) { }
+    void setClientArrayPromotion(bool) { }
 };
 struct gl2_client_context_t {
     int placeholder;
@@ -38,9 +42,14 @@ public:
     GL2Encoder(IOStream*, ChecksumCalculator*) { }
     void setContextAccessor(gl2_client_context_t *()) { }
     void setNoHostError(bool) { }
+    void setGuestOnlyErrors(bool) { }
+    void setVerifyGuestErrors(bool) { }
     void setDrawCallFlushInterval(uint32_t) { }
+    void setAdaptiveDrawCallFlush(bool) { }
     void setHasAsyncUnmapBuffer(int) { }
     void setHasSyncBufferData(int) { }
+    void setProgramBinaryCache(ProgramBinaryCache*) { }
+    void setShadowFreeBufferMinSize(GLsizeiptr) { }
 };
 #else
 #include "GLEncoder.h"
@@ -141,6 +150,77 @@ static uint32_t getDrawCallFlushIntervalFromProperty() {
     return (interval > 0) ? uint32_t(interval) : kDefaultValue;
 }
 
+// Set to 0 to flush draws only every drawFlushInterval draws, instead of
+// also by frame position, pending bytes, vertex count and delay.
+static bool getAdaptiveDrawCallFlushFromProperty() {
+    char value[PROPERTY_VALUE_MAX] = "";
+    property_get("ro.boot.qemu.gltransport.adaptiveDrawFlush", value, "");
+    return strcmp(value, "0") && strcmp(value, "false");
+}
+
+// Set to 0 to always send GLES1 client arrays with each draw, instead of
+// moving arrays that stay the same into hidden buffer objects.
+static bool getClientArrayPromotionFromProperty() {
+    char value[PROPERTY_VALUE_MAX] = "";
+    property_get("ro.boot.qemu.gltransport.gles1ArrayPromotion", value, "");
+    return strcmp(value, "0") && strcmp(value, "false");
+}
+
+// Opt-in: answer glGetError from guest-side validation alone, without
+// falling back to the host. Only for images whose guest validation has
+// been verified to cover what the apps hit.
+static bool getGuestOnlyErrorsFromProperty() {
+    char value[PROPERTY_VALUE_MAX] = "";
+    property_get("ro.boot.qemu.gltransport.guestOnlyErrors", value, "");
+    return !strcmp(value, "1") || !strcmp(value, "true");
+}
+
+// Debug: on glGetError, ask the host as well and log where it disagrees
+// with the error predicted on the guest, to find missing guest validation.
+static bool getVerifyGuestErrorsFromProperty() {
+    char value[PROPERTY_VALUE_MAX] = "";
+    property_get("ro.boot.qemu.gltransport.verifyGuestErrors", value, "");
+    return !strcmp(value, "1") || !strcmp(value, "true");
+}
+
+// Opt-in: directory in which linked program binaries are persisted across
+// process launches. Empty disables the cache.
+static std::string getProgramBinaryCacheDirFromProperty() {
+    char dirValue[PROPERTY_VALUE_MAX] = "";
+    property_get("ro.boot.qemu.gltransport.programBinaryCacheDir", dirValue, "");
+    return dirValue;
+}
+
+// Opt-in: buffers at least this many bytes that are never used for indices
+// or read back skip the guest-side shadow copy. 0 (default) disables.
+static GLsizeiptr getShadowFreeBufferMinSizeFromProperty() {
+    char sizeValue[PROPERTY_VALUE_MAX] = "";
+    property_get("ro.boot.qemu.gltransport.shadowFreeBufferMinSize", sizeValue, "");
+    if (!sizeValue[0]) return 0;
+
+    const long long size = strtoll(sizeValue, 0, 10);
+    return (size > 0) ? GLsizeiptr(size) : 0;
+}
+
+// Opt-in: hand committed command buffers to a per-connection worker thread
+// that does the transport writes.
+static bool getThreadedStreamFromProperty() {
+    char value[PROPERTY_VALUE_MAX] = "";
+    property_get("ro.boot.qemu.gltransport.threadedStream", value, "");
+    return !strcmp(value, "1") || !strcmp(value, "true");
+}
+
+// Opt-in: count calls, bytes and round trips per opcode, and log the
+// process totals every this many frames.
+static uint32_t getEncoderStatsDumpFramesFromProperty() {
+    char value[PROPERTY_VALUE_MAX] = "";
+    property_get("ro.boot.qemu.gltransport.encoderStatsDumpFrames", value, "");
+    if (!value[0]) return 0;
+
+    const long frames = strtol(value, 0, 10);
+    return (frames > 0) ? uint32_t(frames) : 0;
+}
+
 static GrallocType getGrallocTypeFromProperty() {
     char value[PROPERTY_VALUE_MAX] = "";
     property_get("ro.hardware.gralloc", value, "");
@@ -548,12 +628,22 @@ std::unique_ptr<HostConnection> HostConnection::connect() {
 #endif
     }
 
+    if (con->m_stream && getThreadedStreamFromProperty()) {
+        con->m_stream = new ThreadedStream(con->m_stream, STREAM_BUFFER_SIZE / 4);
+    }
+
     // send zero 'clientFlags' to the host.
     unsigned int *pClientFlags =
             (unsigned int *)con->m_stream->allocBuffer(sizeof(unsigned int));
     *pClientFlags = 0;
     con->m_stream->commitBuffer(sizeof(unsigned int));
 
+    // Wrapped after the client flags, which are not a command packet.
+    const uint32_t statsDumpFrames = getEncoderStatsDumpFramesFromProperty();
+    if (statsDumpFrames) {
+        con->m_stream = new EncoderStatsStream(con->m_stream, statsDumpFrames);
+    }
+
     ALOGD("HostConnection::get() New Host Connection established %p, tid %d\n",
           con.get(), getCurrentThreadId());
 
@@ -610,6 +700,7 @@ GLEncoder *HostConnection::glEncoder()
         DBG("HostConnection::glEncoder new encoder %p, tid %d",
             m_glEnc, getCurrentThreadId());
         m_glEnc->setContextAccessor(s_getGLContext);
+        m_glEnc->setClientArrayPromotion(getClientArrayPromotionFromProperty());
     }
     return m_glEnc.get();
 }
@@ -623,10 +714,26 @@ GL2Encoder *HostConnection::gl2Encoder()
             m_gl2Enc, getCurrentThreadId());
         m_gl2Enc->setContextAccessor(s_getGL2Context);
         m_gl2Enc->setNoHostError(m_noHostError);
+        m_gl2Enc->setGuestOnlyErrors(getGuestOnlyErrorsFromProperty());
+        m_gl2Enc->setVerifyGuestErrors(getVerifyGuestErrorsFromProperty());
         m_gl2Enc->setDrawCallFlushInterval(
             getDrawCallFlushIntervalFromProperty());
+        m_gl2Enc->setAdaptiveDrawCallFlush(
+            getAdaptiveDrawCallFlushFromProperty());
         m_gl2Enc->setHasAsyncUnmapBuffer(m_rcEnc->hasAsyncUnmapBuffer());
         m_gl2Enc->setHasSyncBufferData(m_rcEnc->hasSyncBufferData());
+        m_gl2Enc->setShadowFreeBufferMinSize(
+            getShadowFreeBufferMinSizeFromProperty());
+
+        const std::string cacheDir = getProgramBinaryCacheDirFromProperty();
+        if (!cacheDir.empty()) {
+            // Binaries are only valid for the driver that produced them.
+            const std::string rendererKey =
+                queryGLString(m_rcEnc.get(), GL_RENDERER) + "|" +
+                queryGLString(m_rcEnc.get(), GL_VERSION);
+            m_gl2Enc->setProgramBinaryCache(
+                ProgramBinaryCache::get(cacheDir, rendererKey));
+        }
     }
     return m_gl2Enc.get();
 }
@@ -751,6 +858,17 @@ const std::string& HostConnection::queryGLExtensions(ExtendedRCEncoderContext *r
     return m_glExtensions;
 }
 
+std::string HostConnection::queryGLString(ExtendedRCEncoderContext *rcEnc, GLenum name) {
+    std::string res;
+    int size = rcEnc->rcGetGLString(rcEnc, name, NULL, 0);
+    if (size < 0) {
+        res.resize(-size);
+        size = rcEnc->rcGetGLString(rcEnc, name, &res[0], -size);
+        res.resize(size > 0 ? strnlen(res.c_str(), size) : 0);
+    }
+    return res;
+}
+
 void HostConnection::queryAndSetHostCompositionImpl(ExtendedRCEncoderContext *rcEnc) {
     const std::string& glExtensions = queryGLExtensions(rcEnc);
     ALOGD("HostComposition ext %s", glExtensions.c_str());
@@ -217,6 +217,7 @@ private:
     static gl2_client_context_t *s_getGL2Context();
 
     const std::string& queryGLExtensions(ExtendedRCEncoderContext *rcEnc);
+    std::string queryGLString(ExtendedRCEncoderContext *rcEnc, GLenum name);
     // setProtocol initilizes GL communication protocol for checksums
     // should be called when m_rcEnc is created
     void setChecksumHelper(ExtendedRCEncoderContext *rcEnc);
@@ -0,0 +1,188 @@
+/*
+* Copyright (C) 2021 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "ThreadedStream.h"
+
+#if PLATFORM_SDK_VERSION < 26
+#include <cutils/log.h>
+#else
+#include <log/log.h>
+#endif
+#include <string.h>
+
+ThreadedStream::ThreadedStream(IOStream* stream, size_t bufSize) :
+    IOStream(bufSize),
+    m_stream(stream),
+    m_bufsize(bufSize),
+    m_writing(false),
+    m_exiting(false),
+    m_error(false)
+{
+    m_current.size = 0;
+    m_thread = std::thread(&ThreadedStream::threadMain, this);
+}
+
+ThreadedStream::~ThreadedStream()
+{
+    drain();
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_exiting = true;
+    }
+    m_workAvailable.notify_one();
+    m_thread.join();
+
+    m_stream->decRef();
+}
+
+void *ThreadedStream::allocBuffer(size_t minSize)
+{
+    size_t allocSize = (m_bufsize < minSize ? minSize : m_bufsize);
+
+    if (m_current.data.empty()) {
+        takeFreeBuffer(&m_current, allocSize);
+    } else if (m_current.data.size() < allocSize) {
+        m_current.data.resize(allocSize);
+    }
+
+    return m_current.data.data();
+}
+
+int ThreadedStream::commitBuffer(size_t size)
+{
+    if (size == 0) return 0;
+
+    m_current.size = size;
+    return enqueue(&m_current);
+}
+
+const unsigned char *ThreadedStream::readFully(void *buf, size_t len)
+{
+    if (drain() < 0) return NULL;
+    return m_stream->readFully(buf, len);
+}
+
+const unsigned char *ThreadedStream::commitBufferAndReadFully(
+    size_t size, void *buf, size_t len)
+{
+    if (commitBuffer(size) < 0) return NULL;
+    return readFully(buf, len);
+}
+
+const unsigned char *ThreadedStream::read(void *buf, size_t *inout_len)
+{
+    if (drain() < 0) return NULL;
+    return m_stream->read(buf, inout_len);
+}
+
+int ThreadedStream::writeFully(const void *buf, size_t len)
+{
+    if (len == 0) return 0;
+
+    // Large uploads are not worth copying; write them in place once
+    // everything before them is out.
+    if (len > m_bufsize) {
+        if (drain() < 0) return -1;
+        return m_stream->writeFully(buf, len);
+    }
+
+    Buffer buffer;
+    takeFreeBuffer(&buffer, len);
+    memcpy(buffer.data.data(), buf, len);
+    buffer.size = len;
+    return enqueue(&buffer);
+}
+
+void ThreadedStream::threadMain()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    while (true) {
+        m_workAvailable.wait(lock, [this] {
+            return m_exiting || !m_pending.empty();
+        });
+        if (m_pending.empty()) break;
+
+        Buffer buffer;
+        buffer.data.swap(m_pending.front().data);
+        buffer.size = m_pending.front().size;
+        m_pending.pop_front();
+        m_writing = true;
+
+        lock.unlock();
+        int res = m_stream->writeFully(buffer.data.data(), buffer.size);
+        lock.lock();
+
+        m_writing = false;
+        if (res < 0) {
+            ALOGE("ThreadedStream: write of %zu bytes failed\n", buffer.size);
+            m_error = true;
+        }
+
+        // Oversized buffers from one-off large commands are not kept around.
+        if (buffer.data.size() <= 2 * m_bufsize &&
+            m_free.size() < kMaxPendingBuffers) {
+            m_free.push_back(Buffer());
+            m_free.back().data.swap(buffer.data);
+        }
+
+        m_workDone.notify_all();
+    }
+}
+
+int ThreadedStream::enqueue(Buffer* buffer)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    m_workDone.wait(lock, [this] {
+        return m_error ||
+               m_pending.size() + (m_writing ? 1 : 0) < kMaxPendingBuffers;
+    });
+    if (m_error) return -1;
+
+    m_pending.push_back(Buffer());
+    m_pending.back().data.swap(buffer->data);
+    m_pending.back().size = buffer->size;
+    buffer->size = 0;
+
+    m_workAvailable.notify_one();
+    return 0;
+}
+
+int ThreadedStream::drain()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    m_workDone.wait(lock, [this] {
+        return m_pending.empty() && !m_writing;
+    });
+    return m_error ? -1 : 0;
+}
+
+void ThreadedStream::takeFreeBuffer(Buffer* buffer, size_t minSize)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_free.empty()) {
+            buffer->data.swap(m_free.back().data);
+            m_free.pop_back();
+        }
+    }
+
+    if (buffer->data.size() < minSize) {
+        buffer->data.resize(minSize < m_bufsize ? m_bufsize : minSize);
+    }
+}
@@ -0,0 +1,83 @@
+/*
+* Copyright (C) 2021 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef __THREADED_STREAM_H
+#define __THREADED_STREAM_H
+
+/* This file implements an IOStream that hands committed command buffers to
+ * a worker thread, which writes them to the underlying transport stream.
+ * The thread that encodes commands then only pays for filling buffers; the
+ * transport work (pipe writes, ring buffer writes and backoff) happens on
+ * the worker.
+ *
+ * Anything that needs a reply from the host first waits for all queued
+ * buffers to be written, so commands reach the host in encode order.
+ */
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "IOStream.h"
+
+class ThreadedStream : public IOStream {
+public:
+    // Takes over the caller's reference to |stream|.
+    ThreadedStream(IOStream* stream, size_t bufSize);
+    ~ThreadedStream();
+
+    virtual void *allocBuffer(size_t minSize);
+    virtual int commitBuffer(size_t size);
+    virtual const unsigned char *readFully( void *buf, size_t len);
+    virtual const unsigned char *commitBufferAndReadFully(size_t size, void *buf, size_t len);
+    virtual const unsigned char *read( void *buf, size_t *inout_len);
+    virtual int writeFully(const void *buf, size_t len);
+
+private:
+    // Buffers queued or being written at once. Once reached, commits block
+    // until the worker catches up.
+    static const size_t kMaxPendingBuffers = 3;
+
+    struct Buffer {
+        std::vector<unsigned char> data;
+        size_t size;
+    };
+
+    void threadMain();
+    int enqueue(Buffer* buffer);
+    // Waits until every committed buffer is written. Returns -1 if any
+    // write failed.
+    int drain();
+    void takeFreeBuffer(Buffer* buffer, size_t minSize);
+
+    IOStream* m_stream;
+    size_t m_bufsize;
+
+    Buffer m_current;
+
+    std::mutex m_lock;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_workDone;
+    std::deque<Buffer> m_pending;
+    std::vector<Buffer> m_free;
+    bool m_writing;
+    bool m_exiting;
+    bool m_error;
+
+    std::thread m_thread;
+};
+
+#endif
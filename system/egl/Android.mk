@@ -18,6 +18,7 @@ LOCAL_CFLAGS += -Wno-gnu-designator
 LOCAL_SRC_FILES := \
     eglDisplay.cpp \
     egl.cpp \
+    FrameTimeline.cpp \
     ClientAPIExts.cpp
 
 ifneq (true,$(GOLDFISH_OPENGL_BUILD_FOR_HOST))
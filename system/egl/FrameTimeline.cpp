@@ -0,0 +1,254 @@
+/*
+* Copyright (C) 2021 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "FrameTimeline.h"
+
+#include <cutils/properties.h>
+
+#include <algorithm>
+#include <mutex>
+#include <set>
+
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/sync_file.h>
+#endif
+
+namespace {
+
+struct TimelineRegistry {
+    std::mutex lock;
+    std::set<FrameTimeline*> live;
+};
+
+TimelineRegistry* getRegistry() {
+    static TimelineRegistry* registry = new TimelineRegistry;
+    return registry;
+}
+
+uint64_t clockNs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Same clock as currGuestTimeNs() in egl.cpp.
+uint64_t nowNs() {
+#ifdef __APPLE__
+    return clockNs(CLOCK_REALTIME);
+#else
+    return clockNs(CLOCK_BOOTTIME);
+#endif
+}
+
+// Returns when |fd| signaled, 0 if it has not. Sync files report
+// CLOCK_MONOTONIC; where that is not available, the time it is found
+// signaled is used instead.
+uint64_t signaledTimeNs(int fd) {
+#ifdef __linux__
+    struct sync_fence_info fenceInfo;
+    struct sync_file_info info;
+    memset(&info, 0, sizeof(info));
+    memset(&fenceInfo, 0, sizeof(fenceInfo));
+    info.num_fences = 1;
+    info.sync_fence_info = (uint64_t)(uintptr_t)&fenceInfo;
+    if (ioctl(fd, SYNC_IOC_FILE_INFO, &info) == 0 && info.num_fences == 1) {
+        if (info.status != 1) return 0;
+        if (fenceInfo.timestamp_ns) {
+            const uint64_t monotonicToBoottime =
+                nowNs() - clockNs(CLOCK_MONOTONIC);
+            return fenceInfo.timestamp_ns + monotonicToBoottime;
+        }
+    }
+#endif
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    return poll(&pfd, 1, 0) > 0 ? nowNs() : 0;
+}
+
+} // namespace
+
+// static
+bool FrameTimeline::enabled() {
+    static const bool sEnabled = [] {
+        char value[PROPERTY_VALUE_MAX] = "";
+        property_get("debug.graphics.gpu.frametimeline", value, "");
+        return !strcmp(value, "1") || !strcmp(value, "true");
+    }();
+    return sEnabled;
+}
+
+FrameTimeline::FrameTimeline(uint32_t surface) :
+    m_surface(surface),
+    m_inFrame(false),
+    m_frameStartEncodedSize(0),
+    m_currentFenceFd(-1),
+    m_written(0)
+{
+    memset(&m_current, 0, sizeof(m_current));
+    for (size_t i = 0; i < kCapacity; ++i) {
+        m_slots[i].seq.store(0, std::memory_order_relaxed);
+        memset(&m_slots[i].record, 0, sizeof(m_slots[i].record));
+    }
+
+    TimelineRegistry* registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry->lock);
+    registry->live.insert(this);
+}
+
+FrameTimeline::~FrameTimeline()
+{
+    {
+        TimelineRegistry* registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry->lock);
+        registry->live.erase(this);
+    }
+
+    if (m_currentFenceFd >= 0) close(m_currentFenceFd);
+    for (const PendingFence& pending : m_pendingFences) {
+        close(pending.fd);
+    }
+}
+
+void FrameTimeline::onFrameStart(IOStream* stream)
+{
+    memset(&m_current, 0, sizeof(m_current));
+    m_current.surface = m_surface;
+    m_current.dequeue_ns = nowNs();
+    m_inFrame = true;
+
+    m_frameStartEncodedSize = stream->encodedSize();
+    stream->markNextAlloc();
+}
+
+void FrameTimeline::onFlush(IOStream* stream, uint32_t frameNumber)
+{
+    if (!m_inFrame) return;
+
+    m_current.frame_number = frameNumber;
+    m_current.flush_ns = nowNs();
+    m_current.first_command_ns = stream->markedAllocTimeNs();
+    m_current.encoded_bytes = stream->encodedSize() - m_frameStartEncodedSize;
+}
+
+void FrameTimeline::onPresentFence(int presentFenceFd, bool hostFinished)
+{
+    if (!m_inFrame) return;
+
+    m_current.fence_ns = nowNs();
+    if (hostFinished) {
+        m_current.host_complete_ns = m_current.fence_ns;
+    } else if (presentFenceFd >= 0) {
+        m_currentFenceFd = dup(presentFenceFd);
+    }
+}
+
+void FrameTimeline::onQueueBuffer()
+{
+    if (!m_inFrame) return;
+    m_inFrame = false;
+
+    m_current.queue_buffer_ns = nowNs();
+    m_current.sequence = m_written.load(std::memory_order_relaxed);
+    write(m_current);
+    m_written.store(m_current.sequence + 1, std::memory_order_release);
+
+    if (m_currentFenceFd >= 0) {
+        m_pendingFences.push_back({ m_current.sequence, m_currentFenceFd });
+        m_currentFenceFd = -1;
+    } else {
+        // Without a fence, the record is as complete as it gets.
+        goldfish_perfetto_emit_frame(m_current);
+    }
+
+    checkPendingFences();
+}
+
+void FrameTimeline::write(const Record& record)
+{
+    Slot& slot = m_slots[record.sequence % kCapacity];
+    const uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = record;
+    slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+void FrameTimeline::finish(uint64_t sequence, uint64_t hostCompleteNs)
+{
+    // The ring may have moved past the record already.
+    if (sequence + kCapacity < m_written.load(std::memory_order_relaxed)) return;
+
+    Record record = m_slots[sequence % kCapacity].record;
+    if (record.sequence != sequence) return;
+
+    record.host_complete_ns = hostCompleteNs;
+    write(record);
+    goldfish_perfetto_emit_frame(record);
+}
+
+void FrameTimeline::checkPendingFences()
+{
+    while (!m_pendingFences.empty()) {
+        const PendingFence pending = m_pendingFences.front();
+        const uint64_t signaledNs = signaledTimeNs(pending.fd);
+        if (!signaledNs && m_pendingFences.size() <= kMaxPendingFences) break;
+
+        m_pendingFences.pop_front();
+        close(pending.fd);
+        finish(pending.sequence, signaledNs);
+    }
+}
+
+size_t FrameTimeline::getRecords(Record* out, size_t maxRecords) const
+{
+    const uint64_t written = m_written.load(std::memory_order_acquire);
+    const uint64_t count = std::min<uint64_t>(
+        std::min<uint64_t>(written, kCapacity), maxRecords);
+
+    size_t copied = 0;
+    for (uint64_t sequence = written - count; sequence < written; ++sequence) {
+        const Slot& slot = m_slots[sequence % kCapacity];
+        while (true) {
+            const uint32_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq & 1) continue;
+            Record record = slot.record;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != seq) continue;
+
+            // Overwritten by a newer frame while we were getting here.
+            if (record.sequence == sequence) out[copied++] = record;
+            break;
+        }
+    }
+    return copied;
+}
+
+// static
+void FrameTimeline::getAllRecords(std::vector<Record>* out)
+{
+    TimelineRegistry* registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry->lock);
+
+    for (const FrameTimeline* timeline : registry->live) {
+        const size_t start = out->size();
+        out->resize(start + kCapacity);
+        out->resize(start + timeline->getRecords(out->data() + start, kCapacity));
+    }
+}
@@ -0,0 +1,103 @@
+/*
+* Copyright (C) 2021 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef __FRAME_TIMELINE_H
+#define __FRAME_TIMELINE_H
+
+/* This file implements a per window surface record of where the time of
+ * each frame went: from the buffer being dequeued, over the first command
+ * and the bytes encoded for it, the window color buffer flush and the
+ * present fence, to queueBuffer and the host signaling the fence.
+ *
+ * Records are kept in a ring that only the thread swapping the surface
+ * writes. Readers on any thread copy them out without locking, retrying
+ * records that are rewritten while they copy. Finished records also go to
+ * the perfetto producer of system/profiler.
+ *
+ * Recording is off unless debug.graphics.gpu.frametimeline is set.
+ */
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "IOStream.h"
+#include "profiler.h"
+
+class FrameTimeline {
+public:
+    typedef goldfish_frame_timeline Record;
+
+    static const size_t kCapacity = 256;
+
+    explicit FrameTimeline(uint32_t surface);
+    ~FrameTimeline();
+
+    // Whether records are collected in this process.
+    static bool enabled();
+
+    // Called by the thread that swaps the surface, in this order. A frame
+    // starts once its buffer is dequeued and bound to the surface.
+    void onFrameStart(IOStream* stream);
+    // Before the window color buffer flush is encoded.
+    void onFlush(IOStream* stream, uint32_t frameNumber);
+    // After the present fence is created, or, without native sync, after
+    // the host finished the frame if |hostFinished|.
+    void onPresentFence(int presentFenceFd, bool hostFinished);
+    void onQueueBuffer();
+
+    // Copies up to |maxRecords| of the latest records, oldest first.
+    // Returns how many were copied.
+    size_t getRecords(Record* out, size_t maxRecords) const;
+    // Appends the records of every live surface.
+    static void getAllRecords(std::vector<Record>* out);
+
+private:
+    struct Slot {
+        // Odd while the record is being written.
+        std::atomic<uint32_t> seq;
+        Record record;
+    };
+
+    struct PendingFence {
+        uint64_t sequence;
+        int fd;
+    };
+
+    // Fences whose host completion is not known yet. Older ones are given
+    // up on.
+    static const size_t kMaxPendingFences = 8;
+
+    void write(const Record& record);
+    // Fills in the host completion of the pending fences that signaled.
+    void checkPendingFences();
+    void finish(uint64_t sequence, uint64_t hostCompleteNs);
+
+    const uint32_t m_surface;
+
+    Record m_current;
+    bool m_inFrame;
+    uint64_t m_frameStartEncodedSize;
+    int m_currentFenceFd;
+
+    std::deque<PendingFence> m_pendingFences;
+
+    std::atomic<uint64_t> m_written;
+    Slot m_slots[kCapacity];
+};
+
+#endif
@@ -20,6 +20,7 @@
 #endif
 
 #include <assert.h>
+#include <deque>
 #include "HostConnection.h"
 #include "ThreadInfo.h"
 #include "eglDisplay.h"
@@ -34,10 +35,13 @@
 #include "goldfish_sync.h"
 #include "GLClientState.h"
 #include "GLSharedGroup.h"
+#include "ProgramBinaryCache.h"
 #include "eglContext.h"
 #include "ClientAPIExts.h"
 #include "EGLImage.h"
 #include "ProcessPipe.h"
+#include "EncoderStatsStream.h"
+#include "FrameTimeline.h"
 #include "profiler.h"
 
 #include <qemu_pipe_bp.h>
@@ -52,8 +56,8 @@
 #ifdef VIRTIO_GPU
 #include <drm/virtgpu_drm.h>
 #include <xf86drm.h>
-#include <poll.h>
 #endif // VIRTIO_GPU
+#include <poll.h>
 
 #ifdef GFXSTREAM
 #include "android/base/Tracing.h"
@@ -213,6 +217,40 @@ static eglDisplay s_display;
 
 #define EGL_TIMESTAMPS_ANDROID 0x314D
 
+static void destroyHostSync(ExtendedRCEncoderContext* rcEnc, uint64_t handle)
+{
+    if (rcEnc->hasAsyncFrameCommands()) {
+        rcEnc->rcDestroySyncKHRAsync(rcEnc, handle);
+    } else {
+        rcEnc->rcDestroySyncKHR(rcEnc, handle);
+    }
+}
+
+static void releaseNativeFencePoint(NativeFencePoint* point)
+{
+    if (point->refs.fetch_sub(1) != 1) return;
+
+    close(point->fd);
+    DEFINE_HOST_CONNECTION;
+    if (rcEnc) {
+        destroyHostSync(rcEnc, point->handle);
+    }
+    delete point;
+}
+
+// Fences can only share the newest point of a context while nothing else
+// is encoded, so there is no use holding on to it past a swap or once the
+// context is no longer current.
+static void dropLastNativeFence(EGLContext_t* context)
+{
+    if (!context->lastNativeFence) return;
+
+    releaseNativeFencePoint(context->lastNativeFence);
+    context->lastNativeFence = NULL;
+    context->lastNativeFenceStream = NULL;
+    context->lastNativeFenceEncodedSize = 0;
+}
+
 EGLContext_t::EGLContext_t(EGLDisplay dpy, EGLConfig config, EGLContext_t* shareCtx, int maj, int min) :
     dpy(dpy),
     config(config),
@@ -228,6 +266,9 @@ EGLContext_t::EGLContext_t(EGLDisplay dpy, EGLConfig config, EGLContext_t* share
     shaderVersionString(NULL),
     extensionString(NULL),
     deletePending(0),
+    lastNativeFence(NULL),
+    lastNativeFenceStream(NULL),
+    lastNativeFenceEncodedSize(0),
     goldfishSyncFd(-1)
 {
 
@@ -274,6 +315,7 @@ EGLContext_t::~EGLContext_t()
         goldfish_sync_close(goldfishSyncFd);
         goldfishSyncFd = -1;
     }
+    dropLastNativeFence(this);
     assert(dpy == (EGLDisplay)&s_display);
     s_display.onDestroyContext((EGLContext)this);
     delete clientState;
@@ -282,6 +324,9 @@ EGLContext_t::~EGLContext_t()
     delete [] rendererString;
     delete [] shaderVersionString;
     delete [] extensionString;
+    // Binaries linked with this context are written out now, rather than
+    // on every link.
+    ProgramBinaryCache::flushProcessCache();
 }
 
 uint64_t currGuestTimeNs() {
@@ -362,6 +407,86 @@ struct app_time_metric_t {
     }
 };
 
+// Distributions of the time between swaps of a window surface and of the
+// time each swap blocked before queueing its buffer (flush, fence creation
+// and waiting on frames in flight). Logged once a second, like
+// app_time_stats.
+struct frame_time_histogram_t {
+    static const size_t kNumBuckets = 8;
+
+    uint64_t lastLogTime;
+    uint64_t lastSwapTime;
+    uint32_t frameTimes[kNumBuckets];
+    uint32_t swapTimes[kNumBuckets];
+
+    frame_time_histogram_t() :
+        lastLogTime(0),
+        lastSwapTime(0)
+    {
+        reset();
+    }
+
+    void reset() {
+        memset(frameTimes, 0, sizeof(frameTimes));
+        memset(swapTimes, 0, sizeof(swapTimes));
+    }
+
+    // Upper bound in ms of each bucket but the last.
+    static uint32_t bucketLimitMs(size_t bucket) {
+        static const uint32_t kLimitsMs[kNumBuckets - 1] = {
+            2, 4, 8, 17, 33, 50, 100,
+        };
+        return kLimitsMs[bucket];
+    }
+
+    static size_t bucketOf(uint64_t ns) {
+        size_t bucket = 0;
+        while (bucket < kNumBuckets - 1 && ns >= bucketLimitMs(bucket) * 1000000ULL) {
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    static void format(const uint32_t* counts, char* buf, size_t bufSize) {
+        size_t len = 0;
+        buf[0] = 0;
+        for (size_t i = 0; i < kNumBuckets && len < bufSize; ++i) {
+            if (i < kNumBuckets - 1) {
+                len += snprintf(buf + len, bufSize - len, " <%ums:%u",
+                                bucketLimitMs(i), counts[i]);
+            } else {
+                len += snprintf(buf + len, bufSize - len, " >=%ums:%u",
+                                bucketLimitMs(i - 1), counts[i]);
+            }
+        }
+    }
+
+    void onSwapBuffers(uint64_t swapStart, uint64_t queueTime) {
+        ++swapTimes[bucketOf(queueTime - swapStart)];
+        if (lastSwapTime) {
+            ++frameTimes[bucketOf(queueTime - lastSwapTime)];
+        }
+        lastSwapTime = queueTime;
+
+        if (!lastLogTime) {
+            lastLogTime = queueTime;
+            return;
+        }
+
+        // Log/reset once every second
+        if (queueTime - lastLogTime > 1000000000) {
+            char frameBuf[160];
+            char swapBuf[160];
+            format(frameTimes, frameBuf, sizeof(frameBuf));
+            format(swapTimes, swapBuf, sizeof(swapBuf));
+            ALOGD("frame_time_histogram: frame%s", frameBuf);
+            ALOGD("frame_time_histogram: swap%s", swapBuf);
+            reset();
+            lastLogTime = queueTime;
+        }
+    }
+};
+
 // ----------------------------------------------------------------------------
 //egl_surface_t
 
@@ -421,6 +546,7 @@ protected:
     uint32_t    rcSurface; //handle to surface created via remote control
 
     app_time_metric_t appTimeMetric;
+    frame_time_histogram_t frameTimeHistogram;
 };
 
 egl_surface_t::egl_surface_t(EGLDisplay dpy, EGLConfig config, EGLint surfaceType)
@@ -471,10 +597,18 @@ private:
             EGLDisplay dpy, EGLConfig config, EGLint surfType,
             ANativeWindow* window);
     EGLBoolean init();
+    uint64_t waitForFramesInFlight(int presentFenceFd);
 
     ANativeWindow*              nativeWindow;
     android_native_buffer_t*    buffer;
     bool collectingTimestamps;
+
+    // Duplicates of the present fences of queued frames, oldest first.
+    std::deque<int>             inFlightPresentFences;
+    // Frames queued without native sync since the last eglWaitClient().
+    uint32_t                    framesSinceFinish;
+    // NULL unless FrameTimeline::enabled().
+    FrameTimeline*              frameTimeline;
 };
 
 egl_window_surface_t::egl_window_surface_t (
@@ -483,7 +617,9 @@ egl_window_surface_t::egl_window_surface_t (
 :   egl_surface_t(dpy, config, surfType),
     nativeWindow(window),
     buffer(NULL),
-    collectingTimestamps(false)
+    collectingTimestamps(false),
+    framesSinceFinish(0),
+    frameTimeline(NULL)
 {
     // keep a reference on the window
     nativeWindow->common.incRef(&nativeWindow->common);
@@ -516,6 +652,11 @@ EGLBoolean egl_window_surface_t::init()
     rcEnc->rcSetWindowColorBuffer(rcEnc, rcSurface,
             grallocHelper->getHostHandle(buffer->handle));
 
+    if (FrameTimeline::enabled()) {
+        frameTimeline = new FrameTimeline(rcSurface);
+        frameTimeline->onFrameStart(rcEnc->m_stream);
+    }
+
     return EGL_TRUE;
 }
 
@@ -542,6 +683,12 @@ egl_window_surface_t::~egl_window_surface_t() {
         nativeWindow->cancelBuffer_DEPRECATED(nativeWindow, buffer);
     }
     nativeWindow->common.decRef(&nativeWindow->common);
+
+    for (int fd : inFlightPresentFences) {
+        close(fd);
+    }
+
+    delete frameTimeline;
 }
 
 void egl_window_surface_t::setSwapInterval(int interval)
@@ -707,28 +854,54 @@ struct FrameTracingState {
     bool tracingEnabled = false;
     void onSwapBuffersSuccesful(ExtendedRCEncoderContext* rcEnc) {
 #ifdef GFXSTREAM
+        // Also refreshes the flag that encoder trace points test.
         bool current = android::base::isTracingEnabled();
         // edge trigger
-        if (android::base::isTracingEnabled() && !tracingEnabled) {
+        if (current && !tracingEnabled) {
             if (rcEnc->hasHostSideTracing()) {
                 rcEnc->rcSetTracingForPuid(rcEnc, getPuid(), 1, currGuestTimeNs());
             }
         }
-        if (!android::base::isTracingEnabled() && tracingEnabled) {
+        if (!current && tracingEnabled) {
             if (rcEnc->hasHostSideTracing()) {
                 rcEnc->rcSetTracingForPuid(rcEnc, getPuid(), 0, currGuestTimeNs());
             }
         }
-        tracingEnabled = android::base::isTracingEnabled();
+        tracingEnabled = current;
 #endif
         ++frameNumber;
+
+        EncoderStatsStream::OpcodeStats encoderStats;
+        if (EncoderStatsStream::onFrameEnd(&encoderStats)) {
+            atrace_int64(ATRACE_TAG_GRAPHICS, "gfxstreamEncodedCalls", encoderStats.calls);
+            atrace_int64(ATRACE_TAG_GRAPHICS, "gfxstreamEncodedBytes", encoderStats.bytes);
+            atrace_int64(ATRACE_TAG_GRAPHICS, "gfxstreamRoundTrips", encoderStats.roundTrips);
+        }
     }
 };
 
 static FrameTracingState sFrameTracingState;
 
-static void sFlushBufferAndCreateFence(
-    HostConnection* hostCon, ExtendedRCEncoderContext* rcEnc, uint32_t rcSurface, uint32_t frameNumber, int* presentFenceFd) {
+// How many frames a window surface may queue before the host is done with
+// them. With native sync, swaps block on the present fence of the frame
+// that many frames back. Without it, the host is only finished with every
+// that many frames plus one, so frames in between may reach the compositor
+// before they are complete. 0, the default, keeps swaps unpaced with
+// native sync and finishes every frame without it.
+static uint32_t getFramesInFlight() {
+    static const uint32_t framesInFlight = [] {
+        char value[PROPERTY_VALUE_MAX] = "";
+        property_get("ro.boot.qemu.gltransport.framesInFlight", value, "");
+        const long frames = strtol(value, 0, 10);
+        return (frames > 0) ? uint32_t(frames) : 0u;
+    }();
+    return framesInFlight;
+}
+
+// Returns whether the host finished the frame.
+static bool sFlushBufferAndCreateFence(
+    HostConnection* hostCon, ExtendedRCEncoderContext* rcEnc, uint32_t rcSurface, uint32_t frameNumber,
+    bool finish, int* presentFenceFd) {
     atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamFrameNumber", (int32_t)frameNumber);
 
     if (rcEnc->hasHostSideTracing()) {
@@ -747,10 +920,43 @@ static void sFlushBufferAndCreateFence(
                      presentFenceFd);
     } else if (rcEnc->hasNativeSync()) {
         createGoldfishOpenGLNativeSync(presentFenceFd);
-    } else {
+    } else if (finish) {
         // equivalent to glFinish if no native sync
         eglWaitClient();
+        return true;
     }
+    return false;
+}
+
+// Keeps a duplicate of |presentFenceFd| and waits until at most
+// getFramesInFlight() queued frames are unsignaled. Returns the time spent
+// waiting.
+uint64_t egl_window_surface_t::waitForFramesInFlight(int presentFenceFd)
+{
+    const uint32_t framesInFlight = getFramesInFlight();
+    if (!framesInFlight || presentFenceFd < 0) return 0;
+
+    int fd = dup(presentFenceFd);
+    if (fd < 0) return 0;
+    inFlightPresentFences.push_back(fd);
+
+    uint64_t waitStart = 0;
+    while (inFlightPresentFences.size() > framesInFlight) {
+        int oldest = inFlightPresentFences.front();
+        inFlightPresentFences.pop_front();
+
+        struct pollfd pfd = { oldest, POLLIN, 0 };
+        if (poll(&pfd, 1, 0) == 0) {
+            if (!waitStart) waitStart = currGuestTimeNs();
+            if (poll(&pfd, 1, 3000) == 0) {
+                ALOGW("%s: present fence not signaled after 3s, not waiting on it",
+                      __func__);
+            }
+        }
+        close(oldest);
+    }
+
+    return waitStart ? currGuestTimeNs() - waitStart : 0;
 }
 
 EGLBoolean egl_window_surface_t::swapBuffers()
@@ -787,12 +993,36 @@ EGLBoolean egl_window_surface_t::swapBuffers()
     eglWaitClient();
     nativeWindow->queueBuffer(nativeWindow, buffer);
 #else
-    sFlushBufferAndCreateFence(
+    const uint64_t swapStart = currGuestTimeNs();
+
+    bool finish = ++framesSinceFinish > getFramesInFlight();
+    if (finish) framesSinceFinish = 0;
+
+    if (frameTimeline) {
+        frameTimeline->onFlush(rcEnc->m_stream, sFrameTracingState.frameNumber);
+    }
+
+    bool hostFinished = sFlushBufferAndCreateFence(
         hostCon, rcEnc, rcSurface,
-        sFrameTracingState.frameNumber, &presentFenceFd);
+        sFrameTracingState.frameNumber, finish, &presentFenceFd);
+
+    if (frameTimeline) {
+        frameTimeline->onPresentFence(presentFenceFd, hostFinished);
+    }
+
+    const uint64_t waitNs = waitForFramesInFlight(presentFenceFd);
+    if (waitNs) {
+        atrace_int64(ATRACE_TAG_GRAPHICS, "gfxstreamFramesInFlightWaitNs", waitNs);
+    }
+
+    frameTimeHistogram.onSwapBuffers(swapStart, currGuestTimeNs());
 
     DPRINT("queueBuffer with fence %d", presentFenceFd);
     nativeWindow->queueBuffer(nativeWindow, buffer, presentFenceFd);
+
+    if (frameTimeline) {
+        frameTimeline->onQueueBuffer();
+    }
 #endif
 
     appTimeMetric.onQueueBufferReturn();
@@ -821,6 +1051,10 @@ EGLBoolean egl_window_surface_t::swapBuffers()
     rcEnc->rcSetWindowColorBuffer(rcEnc, rcSurface,
             grallocHelper->getHostHandle(buffer->handle));
 
+    if (frameTimeline) {
+        frameTimeline->onFrameStart(rcEnc->m_stream);
+    }
+
     setWidth(buffer->width);
     setHeight(buffer->height);
 
@@ -991,7 +1225,11 @@ static std::vector<std::string> getExtStringArray() {
     // push guest strings
     res.push_back("GL_EXT_robustness");
 
-    if (!hostStr || !strlen(hostStr)) { return res; }
+    if (!hostStr || !strlen(hostStr)) {
+        delete [] hostStr;
+        tInfo->currentContext->extensionStringArray = res;
+        return res;
+    }
 
     // find the number of extensions
     int extStart = 0;
@@ -1148,6 +1386,7 @@ EGLBoolean eglTerminate(EGLDisplay dpy)
     VALIDATE_DISPLAY_INIT(dpy, EGL_FALSE);
 
     s_display.terminate();
+    ProgramBinaryCache::flushProcessCache();
     DEFINE_AND_VALIDATE_HOST_CONNECTION(EGL_FALSE);
     rcEnc->rcGetRendererVersion(rcEnc);
     return EGL_TRUE;
@@ -1248,6 +1487,16 @@ EGLBoolean eglChooseConfig(EGLDisplay dpy, const EGLint *attrib_list, EGLConfig
         }
     }
 
+    // The config table is cached; only ask the host for what it can't
+    // answer. If nothing matches, the host may still map the request to
+    // configs it has (e.g. renderable types it translates).
+    if (s_display.chooseConfigs(local_attrib_list ? local_attrib_list : attrib_list,
+                                configs, config_size, num_config) &&
+        *num_config > 0) {
+        if (local_attrib_list) delete [] local_attrib_list;
+        return EGL_TRUE;
+    }
+
     uint32_t* tempConfigs[config_size];
     DEFINE_AND_VALIDATE_HOST_CONNECTION(EGL_FALSE);
     *num_config = rcEnc->rcChooseConfig(rcEnc,
@@ -1588,10 +1837,14 @@ static EGLBoolean s_eglReleaseThreadImpl(EGLThreadInfo* tInfo) {
     // eglMakeCurrent(&s_display, EGL_NO_CONTEXT, EGL_NO_SURFACE, EGL_NO_SURFACE)
     // with the only issue that we do not require a valid display here.
     DEFINE_AND_VALIDATE_HOST_CONNECTION_FOR_TLS(EGL_FALSE, tInfo);
+    if (context->majorVersion < 2) {
+        hostCon->glEncoder()->deletePromotedArrayBuffers();
+    }
     // We are going to call makeCurrent on the null context and surface
     // anyway once we are on the host, so skip rcMakeCurrent here.
     // rcEnc->rcMakeCurrent(rcEnc, 0, 0, 0);
     context->flags &= ~EGLContext_t::IS_CURRENT;
+    dropLastNativeFence(context);
 
     s_destroyPendingSurfacesInContext(context);
 
@@ -1972,12 +2225,31 @@ EGLBoolean eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLC
     }
 
     DEFINE_AND_VALIDATE_HOST_CONNECTION(EGL_FALSE);
+    // GLES1 hidden client array buffers live in the share group, which may
+    // outlive the context; delete them while it is still current.
+    if (prevCtx && prevCtx != context && prevCtx->majorVersion < 2) {
+        hostCon->glEncoder()->deletePromotedArrayBuffers();
+    }
     if (rcEnc->hasAsyncFrameCommands()) {
         rcEnc->rcMakeCurrentAsync(rcEnc, ctxHandle, drawHandle, readHandle);
     } else {
         rcEnc->rcMakeCurrent(rcEnc, ctxHandle, drawHandle, readHandle);
     }
 
+    // Only the surfaces changed; the encoders are already set up for the
+    // context.
+    if (context && context == tInfo->currentContext) {
+        context->draw = draw;
+        context->read = read;
+        if (drawSurf) {
+            drawSurf->setIsCurrent(true);
+        }
+        if (readSurf) {
+            readSurf->setIsCurrent(true);
+        }
+        return EGL_TRUE;
+    }
+
     //Now make the local bind
     if (context) {
 
@@ -2063,6 +2335,7 @@ EGLBoolean eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLC
 
     // Delete the previous context here
     if (tInfo->currentContext && (tInfo->currentContext != context)) {
+        dropLastNativeFence(tInfo->currentContext);
         tInfo->currentContext->flags &= ~EGLContext_t::IS_CURRENT;
         if (tInfo->currentContext->deletePending && tInfo->currentContext != context) {
             eglDestroyContext(dpy, tInfo->currentContext);
@@ -2080,9 +2353,11 @@ EGLBoolean eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLC
                 hostCon->gl2Encoder()->setInitialized();
                 ClientAPIExts::initClientFuncs(s_display.gles2_iface(), 1);
             }
+            // getGLString() fills in the array of the context as well.
             const char* exts = getGLString(GL_EXTENSIONS);
             if (exts) {
-                hostCon->gl2Encoder()->setExtensions(exts, getExtStringArray());
+                hostCon->gl2Encoder()->setExtensions(
+                    exts, tInfo->currentContext->extensionStringArray);
             }
         }
         else {
@@ -2202,6 +2477,43 @@ EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface eglSurface)
     // post the surface
     EGLBoolean ret = d->swapBuffers();
 
+    EGLContext_t* context = getEGLThreadInfo()->currentContext;
+    if (context) {
+        dropLastNativeFence(context);
+    }
+    if (context && context->majorVersion > 1) {
+        GL2Encoder::DrawCallFlushStats flushStats =
+            hostCon->gl2Encoder()->onFrameEnd();
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamDrawCalls", flushStats.draws);
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamDrawFlushes", flushStats.flushes);
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamDrawFlushesFrameStart", flushStats.frameStartFlushes);
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamDrawFlushesPendingBytes", flushStats.pendingBytesFlushes);
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamDrawFlushesDrawCost", flushStats.drawCostFlushes);
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamDrawFlushesDelay", flushStats.delayFlushes);
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamDrawFlushesInterval", flushStats.intervalFlushes);
+        atrace_int64(ATRACE_TAG_GRAPHICS, "gfxstreamShadowFreeBufferBytes",
+                     context->getSharedGroup()->getShadowFreeBufferBytes());
+    } else if (context) {
+        GLEncoder::VertexDataStats vertexStats =
+            hostCon->glEncoder()->onFrameEnd();
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamGles1Draws", vertexStats.draws);
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamGles1BindsElided", vertexStats.bindsElided);
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamGles1ClientActiveTexturesElided", vertexStats.clientActiveTexturesElided);
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamGles1ArraysSent", vertexStats.arraysSent);
+        atrace_int64(ATRACE_TAG_GRAPHICS, "gfxstreamGles1ArrayBytesSent", vertexStats.bytesSent);
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamGles1PromotedArrayDraws", vertexStats.promotedArrayDraws);
+        atrace_int(ATRACE_TAG_GRAPHICS, "gfxstreamGles1PromotedUploads", vertexStats.promotedUploads);
+        atrace_int64(ATRACE_TAG_GRAPHICS, "gfxstreamGles1PromotedUploadBytes", vertexStats.promotedUploadBytes);
+    }
+    if (context) {
+        atrace_int64(ATRACE_TAG_GRAPHICS, "gfxstreamClientStateBytes",
+                     context->getClientState()->getApproximateMemoryUsage());
+    }
+
+    // Apps rarely tear down contexts or call eglTerminate, so this is
+    // where newly linked program binaries normally reach disk.
+    ProgramBinaryCache::flushProcessCacheIfDue();
+
     hostCon->flush();
     return ret;
 }
@@ -2407,6 +2719,29 @@ EGLSyncKHR eglCreateSyncKHR(EGLDisplay dpy, EGLenum type,
         }
     }
 
+    // A native fence created with nothing encoded since the newest one of
+    // the context signals with it; share that one instead of another host
+    // round trip and kernel fence.
+    EGLContext_t* context = tInfo->currentContext;
+    IOStream* stream = rcEnc->m_stream;
+    const bool sharesPoints =
+        type == EGL_SYNC_NATIVE_FENCE_ANDROID && inputFenceFd < 0 &&
+        (rcEnc->hasVirtioGpuNativeSync() || rcEnc->hasNativeSync());
+    if (sharesPoints && context->lastNativeFence &&
+        context->lastNativeFenceStream == stream &&
+        context->lastNativeFenceEncodedSize == stream->encodedSize()) {
+        NativeFencePoint* point = context->lastNativeFence;
+        int fd = dup(point->fd);
+        if (fd >= 0) {
+            point->refs.fetch_add(1);
+            EGLSync_t* syncRes = new EGLSync_t(point->handle);
+            syncRes->type = EGL_SYNC_NATIVE_FENCE_ANDROID;
+            syncRes->android_native_fence_fd = fd;
+            syncRes->point = point;
+            return (EGLSyncKHR)syncRes;
+        }
+    }
+
     uint64_t sync_handle = 0;
     int newFenceFd = -1;
 
@@ -2450,6 +2785,22 @@ EGLSyncKHR eglCreateSyncKHR(EGLDisplay dpy, EGLenum type,
                 syncRes->android_native_fence_fd = inputFenceFd;
             }
         }
+
+        int pointFd = (sharesPoints && newFenceFd >= 0) ? dup(newFenceFd) : -1;
+        if (pointFd >= 0) {
+            NativeFencePoint* point = new NativeFencePoint(sync_handle, pointFd);
+            point->refs.fetch_add(1);
+            syncRes->point = point;
+
+            if (context->lastNativeFence) {
+                releaseNativeFencePoint(context->lastNativeFence);
+            }
+            // After the release, which may encode the destruction of the
+            // previous host sync object.
+            context->lastNativeFence = point;
+            context->lastNativeFenceStream = stream;
+            context->lastNativeFenceEncodedSize = stream->encodedSize();
+        }
     } else {
         syncRes->type = EGL_SYNC_FENCE_KHR;
         syncRes->android_native_fence_fd = -1;
@@ -2477,14 +2828,13 @@ EGLBoolean eglDestroySyncKHR(EGLDisplay dpy, EGLSyncKHR eglsync)
         sync->android_native_fence_fd = -1;
     }
 
-    if (sync) {
+    if (sync && sync->point) {
+        releaseNativeFencePoint(sync->point);
+        delete sync;
+    } else if (sync) {
         DEFINE_HOST_CONNECTION;
         if (rcEnc->hasVirtioGpuNativeSync() || rcEnc->hasNativeSync()) {
-            if (rcEnc->hasAsyncFrameCommands()) {
-                rcEnc->rcDestroySyncKHRAsync(rcEnc, sync->handle);
-            } else {
-                rcEnc->rcDestroySyncKHR(rcEnc, sync->handle);
-            }
+            destroyHostSync(rcEnc, sync->handle);
         }
         delete sync;
     }
@@ -18,6 +18,8 @@
 
 #include "GLClientState.h"
 #include "GLSharedGroup.h"
+#include "IOStream.h"
+#include "eglSync.h"
 
 #include <string>
 #include <vector>
@@ -49,6 +51,11 @@ struct EGLContext_t {
     const char*         extensionString;
     std::vector<std::string> extensionStringArray;
     EGLint              deletePending;
+    // The newest native fence of the context, and how much had been
+    // encoded on the stream once it was created.
+    NativeFencePoint*   lastNativeFence;
+    IOStream*           lastNativeFenceStream;
+    uint64_t            lastNativeFenceEncodedSize;
     GLClientState * getClientState(){ return clientState; }
     GLSharedGroupPtr getSharedGroup(){ return sharedGroup; }
     int getGoldfishSyncFd();
@@ -22,6 +22,7 @@
 #include "android/base/system/System.cpp"
 #endif
 
+#include <algorithm>
 #include <string>
 
 #include <dlfcn.h>
@@ -71,6 +72,7 @@ eglDisplay::eglDisplay() :
     m_numConfigAttribs(0),
     m_attribs(),
     m_configs(NULL),
+    m_chooseConfigAttribsKnown(0),
     m_gles_iface(NULL),
     m_gles2_iface(NULL),
     m_versionString(NULL),
@@ -197,6 +199,7 @@ bool eglDisplay::initialize(EGLClient_eglInterface *eglIface)
 
         memcpy(m_configs, tmp_buf + m_numConfigAttribs,
                m_numConfigs*m_numConfigAttribs*sizeof(EGLint));
+        buildChooseConfigIndex();
 
         m_initialized = true;
     }
@@ -472,23 +475,32 @@ bool eglDisplay::isValidConfig(EGLConfig cfg) const {
     return !(asInt < 0 || asInt > m_numConfigs);
 }
 
-EGLBoolean eglDisplay::getConfigAttrib(EGLConfig config, EGLint attrib, EGLint * value)
+// Attributes the guest answers the same for every config.
+static bool getGuestConfigAttrib(EGLint attrib, EGLint * value)
 {
     if (attrib == EGL_FRAMEBUFFER_TARGET_ANDROID) {
         *value = EGL_TRUE;
-        return EGL_TRUE;
+        return true;
     }
     if (attrib == EGL_COVERAGE_SAMPLES_NV ||
         attrib == EGL_COVERAGE_BUFFERS_NV) {
         *value = 0;
-        return EGL_TRUE;
+        return true;
     }
     if (attrib == EGL_DEPTH_ENCODING_NV) {
         *value = EGL_DEPTH_ENCODING_NONE_NV;
-        return EGL_TRUE;
+        return true;
     }
     if  (attrib == EGL_COLOR_COMPONENT_TYPE_EXT) {
         *value = EGL_COLOR_COMPONENT_TYPE_FIXED_EXT;
+        return true;
+    }
+    return false;
+}
+
+EGLBoolean eglDisplay::getConfigAttrib(EGLConfig config, EGLint attrib, EGLint * value)
+{
+    if (getGuestConfigAttrib(attrib, value)) {
         return EGL_TRUE;
     }
     //Though it seems that valueFor() is thread-safe, we don't take chanses
@@ -503,6 +515,243 @@ EGLBoolean eglDisplay::getConfigAttrib(EGLConfig config, EGLint attrib, EGLint *
     return ret;
 }
 
+namespace {
+
+enum ChooseConfigMatch {
+    MATCH_EXACT,
+    MATCH_AT_LEAST,
+    MATCH_MASK,
+};
+
+struct ChooseConfigAttrib {
+    EGLint attrib;
+    EGLint defaultValue;
+    ChooseConfigMatch match;
+};
+
+// Table 3.4 of the EGL 1.5 spec, plus the Android attributes.
+const ChooseConfigAttrib kChooseConfigAttribs[] = {
+    { EGL_BUFFER_SIZE, 0, MATCH_AT_LEAST },
+    { EGL_RED_SIZE, 0, MATCH_AT_LEAST },
+    { EGL_GREEN_SIZE, 0, MATCH_AT_LEAST },
+    { EGL_BLUE_SIZE, 0, MATCH_AT_LEAST },
+    { EGL_LUMINANCE_SIZE, 0, MATCH_AT_LEAST },
+    { EGL_ALPHA_SIZE, 0, MATCH_AT_LEAST },
+    { EGL_ALPHA_MASK_SIZE, 0, MATCH_AT_LEAST },
+    { EGL_BIND_TO_TEXTURE_RGB, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_BIND_TO_TEXTURE_RGBA, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_COLOR_BUFFER_TYPE, EGL_RGB_BUFFER, MATCH_EXACT },
+    { EGL_CONFIG_CAVEAT, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_CONFIG_ID, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_CONFORMANT, 0, MATCH_MASK },
+    { EGL_DEPTH_SIZE, 0, MATCH_AT_LEAST },
+    { EGL_LEVEL, 0, MATCH_EXACT },
+    { EGL_MAX_SWAP_INTERVAL, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_MIN_SWAP_INTERVAL, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_NATIVE_RENDERABLE, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_NATIVE_VISUAL_TYPE, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_RENDERABLE_TYPE, EGL_OPENGL_ES_BIT, MATCH_MASK },
+    { EGL_SAMPLE_BUFFERS, 0, MATCH_AT_LEAST },
+    { EGL_SAMPLES, 0, MATCH_AT_LEAST },
+    { EGL_STENCIL_SIZE, 0, MATCH_AT_LEAST },
+    { EGL_SURFACE_TYPE, EGL_WINDOW_BIT, MATCH_MASK },
+    { EGL_TRANSPARENT_TYPE, EGL_NONE, MATCH_EXACT },
+    { EGL_TRANSPARENT_RED_VALUE, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_TRANSPARENT_GREEN_VALUE, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_TRANSPARENT_BLUE_VALUE, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_RECORDABLE_ANDROID, EGL_DONT_CARE, MATCH_EXACT },
+    { EGL_FRAMEBUFFER_TARGET_ANDROID, EGL_DONT_CARE, MATCH_EXACT },
+};
+
+const int kNumChooseConfigAttribs =
+    sizeof(kChooseConfigAttribs) / sizeof(kChooseConfigAttribs[0]);
+
+int chooseConfigAttribIndex(EGLint attrib) {
+    for (int i = 0; i < kNumChooseConfigAttribs; ++i) {
+        if (kChooseConfigAttribs[i].attrib == attrib) return i;
+    }
+    return -1;
+}
+
+// Indices of the attributes the sort order of the spec looks at.
+enum {
+    CHOOSE_BUFFER_SIZE = 0,
+    CHOOSE_RED_SIZE = 1,
+    CHOOSE_GREEN_SIZE = 2,
+    CHOOSE_BLUE_SIZE = 3,
+    CHOOSE_LUMINANCE_SIZE = 4,
+    CHOOSE_ALPHA_SIZE = 5,
+    CHOOSE_ALPHA_MASK_SIZE = 6,
+    CHOOSE_COLOR_BUFFER_TYPE = 9,
+    CHOOSE_CONFIG_CAVEAT = 10,
+    CHOOSE_CONFIG_ID = 11,
+    CHOOSE_DEPTH_SIZE = 13,
+    CHOOSE_SAMPLE_BUFFERS = 20,
+    CHOOSE_SAMPLES = 21,
+    CHOOSE_STENCIL_SIZE = 22,
+    CHOOSE_TRANSPARENT_TYPE = 24,
+    CHOOSE_TRANSPARENT_RED_VALUE = 25,
+    CHOOSE_TRANSPARENT_BLUE_VALUE = 27,
+};
+
+int caveatRank(EGLint caveat) {
+    switch (caveat) {
+        case EGL_NONE: return 0;
+        case EGL_SLOW_CONFIG: return 1;
+        default: return 2;
+    }
+}
+
+} // namespace
+
+void eglDisplay::buildChooseConfigIndex()
+{
+    static_assert(kNumChooseConfigAttribs <= 32, "known attributes are a 32-bit mask");
+
+    m_chooseConfigAttribsKnown = 0;
+    m_chooseConfigValues.assign(m_numConfigs * kNumChooseConfigAttribs, EGL_DONT_CARE);
+
+    for (int k = 0; k < kNumChooseConfigAttribs; ++k) {
+        const EGLint attrib = kChooseConfigAttribs[k].attrib;
+
+        EGLint guestValue;
+        if (getGuestConfigAttrib(attrib, &guestValue)) {
+            for (int c = 0; c < m_numConfigs; ++c) {
+                m_chooseConfigValues[c * kNumChooseConfigAttribs + k] = guestValue;
+            }
+        } else {
+            std::map<EGLint, EGLint>::const_iterator it = m_attribs.find(attrib);
+            if (it == m_attribs.end()) continue;
+            for (int c = 0; c < m_numConfigs; ++c) {
+                m_chooseConfigValues[c * kNumChooseConfigAttribs + k] =
+                    m_configs[c * m_numConfigAttribs + it->second];
+            }
+        }
+        m_chooseConfigAttribsKnown |= 1u << k;
+    }
+}
+
+bool eglDisplay::chooseConfigs(const EGLint* attrib_list, EGLConfig* configs,
+                               EGLint config_size, EGLint* num_config) const
+{
+    EGLint wanted[kNumChooseConfigAttribs];
+    for (int k = 0; k < kNumChooseConfigAttribs; ++k) {
+        wanted[k] = kChooseConfigAttribs[k].defaultValue;
+    }
+
+    for (const EGLint* p = attrib_list; p[0] != EGL_NONE; p += 2) {
+        switch (p[0]) {
+            // Ignored by eglChooseConfig.
+            case EGL_MAX_PBUFFER_WIDTH:
+            case EGL_MAX_PBUFFER_HEIGHT:
+            case EGL_MAX_PBUFFER_PIXELS:
+            case EGL_NATIVE_VISUAL_ID:
+                continue;
+        }
+        const int k = chooseConfigAttribIndex(p[0]);
+        if (k < 0) return false;
+        wanted[k] = p[1];
+    }
+
+    // A config ID overrides everything else.
+    if (wanted[CHOOSE_CONFIG_ID] != EGL_DONT_CARE) {
+        for (int k = 0; k < kNumChooseConfigAttribs; ++k) {
+            if (k != CHOOSE_CONFIG_ID) wanted[k] = EGL_DONT_CARE;
+        }
+    }
+    if (wanted[CHOOSE_TRANSPARENT_TYPE] != EGL_TRANSPARENT_RGB) {
+        for (int k = CHOOSE_TRANSPARENT_RED_VALUE; k <= CHOOSE_TRANSPARENT_BLUE_VALUE; ++k) {
+            wanted[k] = EGL_DONT_CARE;
+        }
+    }
+
+    // Criteria every config meets need no column of the table.
+    uint32_t checked = 0;
+    for (int k = 0; k < kNumChooseConfigAttribs; ++k) {
+        if (wanted[k] == EGL_DONT_CARE) continue;
+        if (kChooseConfigAttribs[k].match != MATCH_EXACT && wanted[k] == 0) continue;
+        checked |= 1u << k;
+    }
+    if (checked & ~m_chooseConfigAttribsKnown) return false;
+
+    std::vector<uint32_t> matches;
+    for (int c = 0; c < m_numConfigs; ++c) {
+        const EGLint* values = &m_chooseConfigValues[c * kNumChooseConfigAttribs];
+        bool match = true;
+        for (int k = 0; k < kNumChooseConfigAttribs && match; ++k) {
+            if (!(checked & (1u << k))) continue;
+            switch (kChooseConfigAttribs[k].match) {
+                case MATCH_EXACT:
+                    match = values[k] == wanted[k];
+                    break;
+                case MATCH_AT_LEAST:
+                    match = values[k] >= wanted[k];
+                    break;
+                case MATCH_MASK:
+                    match = (values[k] & wanted[k]) == wanted[k];
+                    break;
+            }
+        }
+        if (match) matches.push_back(c);
+    }
+
+    // Components count towards the sort only if they were asked for.
+    bool sortBy[kNumChooseConfigAttribs] = {};
+    for (int k = CHOOSE_RED_SIZE; k <= CHOOSE_ALPHA_SIZE; ++k) {
+        sortBy[k] = wanted[k] != EGL_DONT_CARE && wanted[k] != 0;
+    }
+
+    const EGLint* table = m_chooseConfigValues.data();
+    std::sort(matches.begin(), matches.end(), [table, &sortBy](uint32_t a, uint32_t b) {
+        const EGLint* va = table + a * kNumChooseConfigAttribs;
+        const EGLint* vb = table + b * kNumChooseConfigAttribs;
+
+        if (va[CHOOSE_CONFIG_CAVEAT] != vb[CHOOSE_CONFIG_CAVEAT]) {
+            return caveatRank(va[CHOOSE_CONFIG_CAVEAT]) < caveatRank(vb[CHOOSE_CONFIG_CAVEAT]);
+        }
+        if (va[CHOOSE_COLOR_BUFFER_TYPE] != vb[CHOOSE_COLOR_BUFFER_TYPE]) {
+            return va[CHOOSE_COLOR_BUFFER_TYPE] == EGL_RGB_BUFFER;
+        }
+
+        // Larger is better here, unlike for the rest.
+        EGLint colorBitsA = 0, colorBitsB = 0;
+        const bool rgb = va[CHOOSE_COLOR_BUFFER_TYPE] != EGL_LUMINANCE_BUFFER;
+        for (int k = CHOOSE_RED_SIZE; k <= CHOOSE_ALPHA_SIZE; ++k) {
+            if (!sortBy[k]) continue;
+            if (rgb ? k == CHOOSE_LUMINANCE_SIZE
+                    : (k != CHOOSE_LUMINANCE_SIZE && k != CHOOSE_ALPHA_SIZE)) {
+                continue;
+            }
+            colorBitsA += va[k];
+            colorBitsB += vb[k];
+        }
+        if (colorBitsA != colorBitsB) return colorBitsA > colorBitsB;
+
+        static const int kSmallerFirst[] = {
+            CHOOSE_BUFFER_SIZE, CHOOSE_SAMPLE_BUFFERS, CHOOSE_SAMPLES,
+            CHOOSE_DEPTH_SIZE, CHOOSE_STENCIL_SIZE, CHOOSE_ALPHA_MASK_SIZE,
+            CHOOSE_CONFIG_ID,
+        };
+        for (size_t i = 0; i < sizeof(kSmallerFirst) / sizeof(kSmallerFirst[0]); ++i) {
+            const int k = kSmallerFirst[i];
+            if (va[k] != vb[k]) return va[k] < vb[k];
+        }
+        return a < b;
+    });
+
+    if (!configs) {
+        *num_config = matches.size();
+        return true;
+    }
+
+    EGLint count = 0;
+    for (; count < config_size && count < (EGLint)matches.size(); ++count) {
+        configs[count] = getConfigAtIndex(matches[count]);
+    }
+    *num_config = count;
+    return true;
+}
+
 void eglDisplay::dumpConfig(EGLConfig config)
 {
     EGLint value = 0;
@@ -31,6 +31,7 @@
 #endif
 
 #include <map>
+#include <vector>
 
 #include <ui/PixelFormat.h>
 
@@ -69,6 +70,12 @@ public:
 
     void     dumpConfig(EGLConfig config);
 
+    // Selects and sorts configs for eglChooseConfig() from the cached config
+    // table, the way the EGL spec does. Returns false if |attrib_list| uses
+    // attributes only the host can evaluate.
+    bool chooseConfigs(const EGLint* attrib_list, EGLConfig* configs,
+                       EGLint config_size, EGLint* num_config) const;
+
     void onCreateContext(EGLContext ctx);
     void onCreateSurface(EGLSurface surface);
 
@@ -88,6 +95,7 @@ private:
     EGLBoolean getAttribValue(EGLConfig config, EGLint attribIdxi, EGLint * value);
     EGLBoolean setAttribValue(EGLConfig config, EGLint attribIdxi, EGLint value);
     void     processConfigs();
+    void     buildChooseConfigIndex();
 
 private:
     pthread_mutex_t m_lock;
@@ -106,6 +114,10 @@ private:
      * v[m_numConfigs-1,0],..,v[m_numConfigs-1,m_numConfigAttribs-1]
      */
     EGLint *m_configs;
+    /* The attributes chooseConfigs() matches, one row per config, in the order
+     * of the table in eglDisplay.cpp, and which of them this table knows. */
+    std::vector<EGLint> m_chooseConfigValues;
+    uint32_t m_chooseConfigAttribsKnown;
     EGLClient_glesInterface *m_gles_iface;
     EGLClient_glesInterface *m_gles2_iface;
     char *m_versionString;
@@ -21,6 +21,21 @@
 #include <EGL/eglext.h>
 #include <inttypes.h>
 
+#include <atomic>
+
+// Native fences a context creates with no commands encoded in between
+// signal together, so they share one host sync object and fence FD. Each
+// EGLSync_t of the point holds a reference and its own dup of the FD, and
+// the context holds one for its newest point. The last reference destroys
+// the host sync object.
+struct NativeFencePoint {
+    NativeFencePoint(uint64_t handle_in, int fd_in) :
+        refs(1), handle(handle_in), fd(fd_in) { }
+    std::atomic<uint32_t> refs;
+    uint64_t handle;
+    int fd;
+};
+
 // EGLSync_t is our driver's internal representation
 // of EGLSyncKHR objects.
 // The components are:
@@ -28,15 +43,18 @@
 // b. android_native_fence_fd: for ANDROID_native_fence_sync
 // when we want to wrap native fence fd's in EGLSyncKHR's
 // c. type/status: track status of fence so SyncAttrib works
+// d. point: the shared host sync object, if any
 struct EGLSync_t {
     EGLSync_t(uint64_t handle_in) :
         handle(handle_in), android_native_fence_fd(-1),
         type(EGL_SYNC_FENCE_KHR),
-        status(EGL_UNSIGNALED_KHR) { }
+        status(EGL_UNSIGNALED_KHR),
+        point(NULL) { }
     uint64_t handle;
     int android_native_fence_fd;
     EGLint type;
     EGLint status;
+    NativeFencePoint* point;
 };
 
 #endif
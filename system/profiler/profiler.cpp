@@ -17,10 +17,33 @@
 #include <android-base/properties.h>
 #include <sys/prctl.h>
 
+#include <atomic>
+
 #include "perfetto.h"
 
+PERFETTO_DEFINE_CATEGORIES(
+    perfetto::Category("gfxstream")
+        .SetDescription("Guest side of gfxstream frames"));
+
+PERFETTO_TRACK_EVENT_STATIC_STORAGE();
+
 namespace {
 
+std::atomic<bool> sPerfettoRegistered(false);
+
+// Guest stages of a surface's frames nest on one track; the host's part
+// overlaps them, so it gets a track of its own.
+perfetto::Track surfaceTrack(uint32_t surface, bool host) {
+  return perfetto::Track((uint64_t(surface) << 1) | (host ? 1 : 0));
+}
+
+void emitSlice(const perfetto::Track& track, const char* name,
+               uint64_t begin_ns, uint64_t end_ns) {
+  if (!begin_ns || !end_ns || end_ns < begin_ns) return;
+  TRACE_EVENT_BEGIN("gfxstream", perfetto::StaticString{name}, track, begin_ns);
+  TRACE_EVENT_END("gfxstream", track, end_ns);
+}
+
 class GpuCounterDataSource : public perfetto::DataSource<GpuCounterDataSource> {
  public:
   void OnSetup(const SetupArgs& args) override {
@@ -90,4 +113,27 @@ void try_register_goldfish_perfetto() {
     dsd.set_name("gpu.renderstages");
     GpuRenderStageDataSource::Register(dsd);
   }
+
+  perfetto::TrackEvent::Register();
+  sPerfettoRegistered = true;
+}
+
+void goldfish_perfetto_emit_frame(const goldfish_frame_timeline& frame) {
+  if (!sPerfettoRegistered) return;
+
+  const perfetto::Track guest = surfaceTrack(frame.surface, false);
+  const perfetto::Track host = surfaceTrack(frame.surface, true);
+
+  if (frame.dequeue_ns && frame.queue_buffer_ns) {
+    TRACE_EVENT_BEGIN("gfxstream", "frame", guest, frame.dequeue_ns,
+                      "frame_number", frame.frame_number,
+                      "encoded_bytes", frame.encoded_bytes);
+    emitSlice(guest, "idle", frame.dequeue_ns, frame.first_command_ns);
+    emitSlice(guest, "encode", frame.first_command_ns, frame.flush_ns);
+    emitSlice(guest, "fence", frame.flush_ns, frame.fence_ns);
+    emitSlice(guest, "queue", frame.fence_ns, frame.queue_buffer_ns);
+    TRACE_EVENT_END("gfxstream", guest, frame.queue_buffer_ns);
+  }
+
+  emitSlice(host, "host", frame.flush_ns, frame.host_complete_ns);
 }
@@ -15,6 +15,28 @@
 #ifndef __PROFILER_H__
 #define __PROFILER_H__
 
+#include <stdint.h>
+
+// One frame of an EGL window surface, from its buffer being dequeued to the
+// host signaling its present fence. Times are CLOCK_BOOTTIME ns; 0 if not
+// known.
+struct goldfish_frame_timeline {
+  uint64_t sequence;  // Position in the surface's record ring.
+  uint32_t frame_number;
+  uint32_t surface;
+  uint64_t dequeue_ns;
+  uint64_t first_command_ns;
+  uint64_t encoded_bytes;
+  uint64_t flush_ns;
+  uint64_t fence_ns;
+  uint64_t host_complete_ns;
+  uint64_t queue_buffer_ns;
+};
+
 extern void try_register_goldfish_perfetto();
 
+// Writes |frame| as slices on tracks of its surface, if the "gfxstream"
+// track event category is being traced.
+extern void goldfish_perfetto_emit_frame(const goldfish_frame_timeline& frame);
+
 #endif //__PROFILER_H__
@@ -17,3 +17,5 @@
 #include "profiler.h"
 
 void try_register_goldfish_perfetto() { }
+
+void goldfish_perfetto_emit_frame(const goldfish_frame_timeline&) { }
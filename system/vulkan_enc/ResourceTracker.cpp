@@ -381,6 +381,8 @@ public:
         zx_handle_t eventHandle = ZX_HANDLE_INVALID;
         zx_koid_t eventKoid = ZX_KOID_INVALID;
         int syncFd = -1;
+        // Imported a sync fd of -1, which stands for one that has signaled.
+        bool syncFdSignaled = false;
     };
 
     struct VkDescriptorUpdateTemplate_Info {
@@ -5505,6 +5507,7 @@ public:
             }
 
             info.syncFd = pImportSemaphoreFdInfo->fd;
+            info.syncFdSignaled = pImportSemaphoreFdInfo->fd < 0;
 
             return VK_SUCCESS;
         } else {
@@ -5797,6 +5800,11 @@ public:
                     if (semInfo.syncFd >= 0) {
                         pre_signal_sync_fds.push_back(semInfo.syncFd);
                         pre_signal_semaphores.push_back(pSubmits[i].pWaitSemaphores[j]);
+                    } else if (semInfo.syncFdSignaled) {
+                        // Nothing to wait for, but the host semaphore still
+                        // needs its signal. The imported payload is temporary.
+                        semInfo.syncFdSignaled = false;
+                        pre_signal_semaphores.push_back(pSubmits[i].pWaitSemaphores[j]);
                     }
 #endif
                 }
@@ -5859,13 +5867,19 @@ public:
 #endif
 #ifdef VK_USE_PLATFORM_ANDROID_KHR
             for (auto fd : pre_signal_sync_fds) {
+                // Buffers handed over from GL are mostly done by the time
+                // Vulkan submits work on them; only wait for those that are
+                // not.
+                if (sync_wait(fd, 0) == 0) continue;
                 preSignalTasks.push_back([fd] {
                     sync_wait(fd, 3000);
                 });
             }
 #endif
-            auto waitGroupHandle = mWorkPool.schedule(preSignalTasks);
-            mWorkPool.waitAll(waitGroupHandle);
+            if (!preSignalTasks.empty()) {
+                auto waitGroupHandle = mWorkPool.schedule(preSignalTasks);
+                mWorkPool.waitAll(waitGroupHandle);
+            }
 
             VkSubmitInfo submit_info = {
                 .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,